@@ -0,0 +1,75 @@
+/*
+Buffered_Writer.h: small output buffer for writing large plans.
+
+Text and binary data are copied into a fixed buffer and handed to the stream whenever it fills, and integers are formatted in
+place with to_chars, so writing a plan needs no temporary strings and no memory that grows with the plan.
+
+*/
+
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+
+using namespace std;
+
+class Buffered_Writer {
+public:
+	explicit Buffered_Writer(ostream& out) : out(out) {}
+	~Buffered_Writer() { flush(); }
+
+	Buffered_Writer(const Buffered_Writer&) = delete;
+	Buffered_Writer& operator=(const Buffered_Writer&) = delete;
+
+	void bytes(const void* data, size_t size) {
+		if (size <= buffer.size() - used) {
+			memcpy(buffer.data() + used, data, size);
+			used += size;
+			return;
+		}
+		const char* p = (const char*)data;
+		while (size > 0) {
+			if (used == buffer.size()) {
+				flush();
+			}
+			size_t chunk = min(size, buffer.size() - used);
+			memcpy(buffer.data() + used, p, chunk);
+			used += chunk;
+			p += chunk;
+			size -= chunk;
+		}
+	}
+
+	void text(string_view s) { bytes(s.data(), s.size()); }
+
+	void put(char c) {
+		if (used == buffer.size()) {
+			flush();
+		}
+		buffer[used++] = c;
+	}
+
+	void number(long long n) {
+		//a long long is at most 20 characters
+		if (buffer.size() - used < 20) {
+			flush();
+		}
+		used = to_chars(buffer.data() + used, buffer.data() + buffer.size(), n).ptr - buffer.data();
+	}
+
+	void flush() {
+		out.write(buffer.data(), used);
+		used = 0;
+	}
+
+private:
+	ostream& out;
+	array<char, 1 << 16> buffer;
+	size_t used = 0;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+Carry_Over.cpp
+Carry-over inventory for the Program class. Instead of sending every rack out in the same run, the racks of batches that use too
+few of the BATCH_CAPACITY rack positions (typically the last few racks, packed by distribute_remainder) are held back and saved
+to an inventory file, and the next run reads them in ahead of its own input so they can join full batches. See Program.h header
+comment for more information on the Program class.
+
+The inventory is plain rack data with one more field per line, the number of runs the rack has already been held for:
+
+    SAMPLEid1 23 1
+
+so it can also be read as an ordinary input file. A rack that has been held for max_hold runs always goes out in the next batch
+it lands in, whatever that batch's fill.
+*/
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include "Program.h"
+#include "Buffered_Writer.h"
+
+using namespace std;
+
+/*
+* name: read_inventory
+* purpose: reads the racks held back by an earlier run, adding them to the undistributed racks ahead of any racks read after it
+* arguments: the path of the inventory file, and a string that is set to a description of the problem if the file is bad
+* returns: true if the inventory was read or doesn't exist yet, false if a line is malformed
+* notes: must be called before read_data/read_file/read_stream/read_buffer, so the held racks come first in read order and are the
+*        first taken from their sample number buckets. a missing third field counts as 0 runs held, and a third field that is
+*        not a whole number of 0 or more, or has anything but blanks after it, is malformed
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_inventory(const string& path, string& error) {
+    ifstream in(path);
+    if (in.fail()) {
+        //nothing has been held yet
+        return true;
+    }
+    auto is_blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+
+    string line;
+    int line_number = 0;
+    while (getline(in, line)) {
+        line_number++;
+        const char* end = line.data() + line.size();
+        string_view id;
+        int num_samples;
+        if (!parse_rack_line(line.data(), end, RACK_CAPACITY, id, num_samples, error)) {
+            error = "inventory line " + to_string(line_number) + ": " + error;
+            return false;
+        }
+        if (num_samples == 0) {
+            continue;
+        }
+
+        //the runs held come after the sample number
+        const char* p = id.data() + id.size();
+        while (p < end && is_blank(*p)) {
+            p++;
+        }
+        while (p < end && !is_blank(*p)) {
+            p++;
+        }
+        while (p < end && is_blank(*p)) {
+            p++;
+        }
+        int held = 0;
+        if (p < end) {
+            from_chars_result parsed = from_chars(p, end, held);
+            const char* rest = parsed.ptr;
+            while (rest < end && is_blank(*rest)) {
+                rest++;
+            }
+            if (parsed.ec != errc() || rest < end || held < 0) {
+                error = "inventory line " + to_string(line_number) + ": expected the number of runs the rack has been held";
+                return false;
+            }
+        }
+
+        if (!racks.add(id, num_samples)) {
+            error = "rack ids take up more than 4 GB";
+            return false;
+        }
+        source_buckets[num_samples].push_back(racks.size() - 1);
+        sources_remaining++;
+        runs_held.push_back(held);
+    }
+    return true;
+}
+
+/*
+* name: hold_underfilled
+* purpose: takes the finished batches that use too few rack positions out of the plan and holds their racks for the next run
+* arguments: the fraction (0 to 1) of the BATCH_CAPACITY positions a batch's sources and destinations must take up for it to go
+*            out now, and the most runs a rack may be held
+* returns: none
+* notes: a batch is only held if none of its racks has been held max_hold times already. the batches left are renumbered in order
+*        and the lower bound is recomputed over their racks. the held racks are written out with write_inventory
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::hold_underfilled(double hold_fill, int max_hold) {
+    held_racks.clear();
+    vector<Batch> kept;
+    array<int, RACK_CAPACITY + 1> kept_frequencies{};
+    for (int i = 0; i < finished_batches.size(); i++) {
+        const vector<int>& sources = finished_batches[i].batch_sources;
+        int positions = sources.size() + batch_destinations(finished_batches[i]);
+        bool hold = positions < hold_fill * BATCH_CAPACITY;
+        for (int j = 0; j < sources.size() && hold; j++) {
+            if (rack_runs_held(sources[j]) >= max_hold) {
+                hold = false;
+            }
+        }
+
+        if (hold) {
+            held_racks.insert(held_racks.end(), sources.begin(), sources.end());
+        }
+        else {
+            kept.push_back(finished_batches[i]);
+            kept.back().batch_num = kept.size();
+            for (int j = 0; j < sources.size(); j++) {
+                kept_frequencies[racks.samples(sources[j])]++;
+            }
+        }
+    }
+    finished_batches = move(kept);
+    batch_lower_bound = compute_lower_bound(kept_frequencies);
+}
+
+/*
+* name: write_inventory
+* purpose: writes the racks held by hold_underfilled as an inventory for read_inventory
+* arguments: the stream to write to
+* returns: none
+* notes: each rack's count of runs held goes up by one. the held racks keep their read order
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_inventory(ostream& out) {
+    vector<int> ordered = held_racks;
+    sort(ordered.begin(), ordered.end());
+    Buffered_Writer writer(out);
+    for (int i = 0; i < ordered.size(); i++) {
+        writer.text(racks.id(ordered[i]));
+        writer.put(' ');
+        writer.number(racks.samples(ordered[i]));
+        writer.put(' ');
+        writer.number(rack_runs_held(ordered[i]) + 1);
+        writer.put('\n');
+    }
+    writer.flush();
+    out.flush();
+}
+
+#define INSTANTIATE_CARRY_OVER(RACK_CAPACITY, BATCH_CAPACITY) \
+    template bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_inventory(const string& path, string& error); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::hold_underfilled(double hold_fill, int max_hold); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_inventory(ostream& out);
+RACK_FORMATS(INSTANTIATE_CARRY_OVER)
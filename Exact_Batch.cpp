@@ -0,0 +1,437 @@
+/*
+Exact_Batch.cpp
+Exact solvers for the Program class: the batch solver used instead of the ratio heuristic when exact mode is turned on, and the
+solver that packs the last few racks in distribute_remainder. See Program.h header comment for more information on the Program class.
+
+Every rack holds one of only RACK_CAPACITY sample numbers, so choosing the fullest batch of k sources is a bounded knapsack over
+sample_frequencies with at most BATCH_CAPACITY - 1 items. The knapsack is solved with one bitset of reachable sample totals per
+number of sources chosen.
+*/
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Program.h"
+
+using namespace std;
+
+/*
+* name: choose_exact_num_sources
+* purpose: finds the number of sources whose fullest batch leaves the fewest destination spots empty
+* arguments: none
+* returns: the number of sources, at least 1
+* notes: k sources fit exactly when the k smallest available sample numbers fit in the (BATCH_CAPACITY - k) destination racks.
+*        that sum only grows and the room only shrinks as k grows, so the first k that does not fit ends the search for the
+*        largest k. the largest k is solved first, and a smaller k is only solved if even its k largest racks could leave fewer
+*        spots empty, since it uses a rack position less and gets a destination rack more. ties go to the larger k, so a batch
+*        that fills exactly is never traded for one with fewer sources
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::choose_exact_num_sources() {
+    int largest = 1;
+    int sum = 0;
+    int num_sources = 0;
+    bool fits = true;
+    for (int num = find_smallest(); num != -1 && fits && num_sources < BATCH_CAPACITY - 1; num = available_mask.lowest_above(num)) {
+        for (int i = 0; i < sample_frequencies[num] && fits && num_sources < BATCH_CAPACITY - 1; i++) {
+            sum += num;
+            num_sources++;
+            fits = sum <= destination_room[BATCH_CAPACITY - num_sources];
+            if (fits) {
+                largest = num_sources;
+            }
+        }
+    }
+
+    int best = largest;
+    build_exact_table(largest, destination_room[BATCH_CAPACITY - largest]);
+    int best_empty = destination_room[BATCH_CAPACITY - largest] - fullest_exact_total(largest, destination_room[BATCH_CAPACITY - largest]);
+    if (best_empty == 0) {
+        return best;
+    }
+
+    //the fewest spots k sources could leave empty, filling with the k largest available racks
+    vector<int> fewest_empty(largest, 0);
+    int smallest_candidate = largest;
+    int top_sum = 0;
+    int k = 0;
+    for (int num = find_next_highest_valid(RACK_CAPACITY + 1); num != -1 && k < largest - 1; num = find_next_highest_valid(num)) {
+        for (int i = 0; i < sample_frequencies[num] && k < largest - 1; i++) {
+            top_sum += num;
+            k++;
+            fewest_empty[k] = max(0, destination_room[BATCH_CAPACITY - k] - top_sum);
+            if (fewest_empty[k] < best_empty) {
+                smallest_candidate = min(smallest_candidate, k);
+            }
+        }
+    }
+    if (smallest_candidate == largest) {
+        return best;
+    }
+
+    build_exact_table(largest, destination_room[BATCH_CAPACITY - smallest_candidate]);
+    for (k = largest - 1; k >= smallest_candidate; k--) {
+        if (fewest_empty[k] >= best_empty) {
+            continue;
+        }
+        int empty = destination_room[BATCH_CAPACITY - k] - fullest_exact_total(k, destination_room[BATCH_CAPACITY - k]);
+        if (empty < best_empty) {
+            best = k;
+            best_empty = empty;
+        }
+    }
+    return best;
+}
+
+/*
+* name: create_exact_batch
+* purpose: creates the next batch with the given number of sources, choosing the sources whose sample total fills the destination
+*          racks exactly, or as tightly as possible
+* arguments: the number of sources, as chosen by choose_exact_num_sources
+* returns: none
+* notes: see compose_exact_batch
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::create_exact_batch(int num_sources) {
+    compose_exact_batch(num_sources);
+    finished_batches.push_back(finalize_spots());
+}
+
+/*
+* name: build_exact_table
+* purpose: finds every sample total up to a capacity that each number of the available racks can reach
+* arguments: the most sources to count, and the largest total to track
+* returns: none
+* notes: fills exact_table. layer t + 1 is built from layer t, and the stored layers are used afterwards to recover a composition
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::build_exact_table(int num_sources, int capacity) {
+    Exact_Table& table = exact_table;
+    table.num_sources = num_sources;
+    table.capacity = capacity;
+    table.num_words = capacity / 64 + 1;
+    table.frequencies = sample_frequencies;
+    int num_words = table.num_words;
+    int layer_size = (num_sources + 1) * num_words;
+
+    table.values.clear();
+    for (int num = find_smallest(); num != -1; num = available_mask.lowest_above(num)) {
+        table.values.push_back(num);
+    }
+    vector<int>& values = table.values;
+    table.layers.assign((values.size() + 1) * layer_size, 0);
+    table.layers[0] = 1;
+
+    for (int t = 0; t < values.size(); t++) {
+        uint64_t* previous = &table.layers[t * layer_size];
+        uint64_t* current = &table.layers[(t + 1) * layer_size];
+        copy(previous, previous + layer_size, current);
+
+        //bounded knapsack: split the available copies of this sample number into pieces of 1, 2, 4, ... so each piece is
+        //a single 0/1 item, then add each piece walking the source count downwards
+        int copies = min(sample_frequencies[values[t]], num_sources);
+        for (int piece = 1; copies > 0; piece *= 2) {
+            int take = min(piece, copies);
+            copies -= take;
+            if (take * values[t] > capacity) {
+                continue;
+            }
+            for (int j = num_sources; j >= take; j--) {
+                shift_or(&current[j * num_words], &current[(j - take) * num_words], take * values[t], num_words);
+            }
+        }
+    }
+}
+
+/*
+* name: fullest_exact_total
+* purpose: finds the largest total exactly num_sources of the available racks reach without going over a limit
+* arguments: the number of sources, at most exact_table.num_sources, and the limit, at most exact_table.capacity
+* returns: the total, -1 if none is reachable
+* notes: reads the last layer of exact_table
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::fullest_exact_total(int num_sources, int limit) {
+    const Exact_Table& table = exact_table;
+    const uint64_t* final_layer = &table.layers[(table.values.size() * (table.num_sources + 1) + num_sources) * table.num_words];
+    for (int total = limit; total >= 0; total--) {
+        if ((final_layer[total / 64] >> (total % 64)) & 1) {
+            return total;
+        }
+    }
+    return -1;
+}
+
+/*
+* name: compose_exact_batch
+* purpose: reserves in the testing array the sources for the next batch whose sample total fills the destination racks exactly, or
+*          as tightly as possible, without taking any racks yet
+* arguments: the number of sources, as chosen by choose_exact_num_sources
+* returns: none
+* notes: when several compositions reach the same total, the one using the most racks with large sample numbers is chosen, since
+*        small racks are the easiest to fit into later batches
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::compose_exact_batch(int num_sources) {
+    clear_testing();
+
+    int capacity = destination_room[BATCH_CAPACITY - num_sources];
+    if (exact_table.num_sources < num_sources || exact_table.capacity < capacity || exact_table.frequencies != sample_frequencies) {
+        build_exact_table(num_sources, capacity);
+    }
+    const vector<int>& values = exact_table.values;
+    int num_words = exact_table.num_words;
+    int layer_size = (exact_table.num_sources + 1) * num_words;
+
+    //find the fullest reachable total with exactly num_sources sources
+    int best_total = fullest_exact_total(num_sources, capacity);
+    if (best_total == -1) {
+        cerr << "no exact batch found for " << num_sources << " sources, exiting now" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    //walk the layers back from the largest sample number, taking as many of each as still leaves the rest reachable
+    int j = num_sources;
+    int total = best_total;
+    for (int t = values.size() - 1; t >= 0; t--) {
+        const uint64_t* previous = &exact_table.layers[t * layer_size];
+        int most = min(min(sample_frequencies[values[t]], j), total / values[t]);
+        for (int count = most; count >= 0; count--) {
+            int rest = total - count * values[t];
+            if ((previous[(j - count) * num_words + rest / 64] >> (rest % 64)) & 1) {
+                for (int i = 0; i < count; i++) {
+                    add_in_order(values[t]);
+                }
+                j -= count;
+                total = rest;
+                break;
+            }
+        }
+    }
+}
+
+/*
+* name: pack_remainder
+* purpose: splits the last few racks into the fewest batches possible, and of those splits the one using the fewest destination racks
+* arguments: the load of each rack, which is its sample number plus RACK_CAPACITY
+* returns: the batch (0, 1, ...) each rack goes in, in the same order as loads
+* notes: a batch is valid exactly when its loads add up to at most BATCH_CAPACITY * RACK_CAPACITY, so this is bin packing. the
+*        remainder has fewer than BATCH_CAPACITY racks with a load of at most 2 * RACK_CAPACITY each, so any half of them (rounded
+*        up) fits in one batch and the remainder always fits in 2. a lower bound of total load / capacity of 1 puts every rack in one
+*        batch. for 2, a subset-sum bitset per number of racks gives every (racks, samples) the first batch can take, in
+*        O(n^2 * capacity / 64), and each split where both batches fit is scored by its destination racks. the first-fit decreasing
+*        plan is only returned as a fallback, should no split be found
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+vector<int> Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::pack_remainder(const vector<int>& loads) {
+    const int capacity = BATCH_CAPACITY * RACK_CAPACITY;
+    int n = loads.size();
+    vector<int> group_of(n, 0);
+    if (n == 0) {
+        return group_of;
+    }
+
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += loads[i];
+    }
+    int lower_bound = (total + capacity - 1) / capacity;
+
+    //first-fit decreasing
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return loads[a] > loads[b]; });
+    vector<int> bin_loads;
+    for (int k = 0; k < n; k++) {
+        int i = order[k];
+        int bin = 0;
+        while (bin < bin_loads.size() && bin_loads[bin] + loads[i] > capacity) {
+            bin++;
+        }
+        if (bin == bin_loads.size()) {
+            bin_loads.push_back(0);
+        }
+        bin_loads[bin] += loads[i];
+        group_of[i] = bin;
+    }
+    if (lower_bound != 2) {
+        return group_of;
+    }
+
+    //layers[k][c] is the bitset of sample totals reachable using exactly c of the first k racks in order, up to capacity
+    const int num_words = capacity / 64 + 1;
+    const int layer_size = (n + 1) * num_words;
+    vector<uint64_t> layers((n + 1) * layer_size, 0);
+    layers[0] = 1;
+    int total_samples = 0;
+    for (int k = 0; k < n; k++) {
+        int samples = loads[order[k]] - RACK_CAPACITY;
+        total_samples += samples;
+        const uint64_t* previous = &layers[k * layer_size];
+        uint64_t* current = &layers[(k + 1) * layer_size];
+        copy(previous, previous + layer_size, current);
+        for (int c = 1; c <= k + 1; c++) {
+            shift_or(&current[c * num_words], &previous[(c - 1) * num_words], samples, num_words);
+        }
+    }
+
+    //of the splits where both batches fit, take the one with the fewest destination racks, then the fullest first batch
+    auto destinations = [](int samples) { return (samples + RACK_CAPACITY - 1) / RACK_CAPACITY; };
+    const uint64_t* final_layer = &layers[n * layer_size];
+    int best_count = -1;
+    int best_samples = -1;
+    int best_destinations = 0;
+    int best_load = -1;
+    for (int c = 1; c < n; c++) {
+        for (int samples = 0; samples + c * RACK_CAPACITY <= capacity; samples++) {
+            int load = samples + c * RACK_CAPACITY;
+            if (total - load > capacity || !((final_layer[c * num_words + samples / 64] >> (samples % 64)) & 1)) {
+                continue;
+            }
+            int num_destinations = destinations(samples) + destinations(total_samples - samples);
+            if (best_count == -1 || num_destinations < best_destinations || (num_destinations == best_destinations && load > best_load)) {
+                best_count = c;
+                best_samples = samples;
+                best_destinations = num_destinations;
+                best_load = load;
+            }
+        }
+    }
+    //can't happen, see the notes above
+    if (best_count == -1) {
+        return group_of;
+    }
+
+    //walk back from the last rack, taking a rack into the first batch whenever its count and total can't be reached without it
+    int c = best_count;
+    int samples = best_samples;
+    for (int k = n - 1; k >= 0; k--) {
+        const uint64_t* previous = &layers[k * layer_size];
+        if ((previous[c * num_words + samples / 64] >> (samples % 64)) & 1) {
+            group_of[order[k]] = 1;
+        }
+        else {
+            group_of[order[k]] = 0;
+            c--;
+            samples -= loads[order[k]] - RACK_CAPACITY;
+        }
+    }
+    return group_of;
+}
+
+/*
+* name: pack_mixed_remainder
+* purpose: splits the last few racks into the fewest batches possible when destination formats are mixed
+* arguments: the sample number of each rack
+* returns: the batch (0, 1, ...) each rack goes in, in the same order as samples
+* notes: with mixed formats the room in a batch is not linear in its number of sources, so pack_remainder's single load per rack
+*        doesn't apply. first-fit decreasing gives a starting plan, then a branch and bound puts the racks, largest first, into
+*        each open batch they fit in or into a new one, cutting any branch that can't beat the best plan so far. a rack equal to
+*        the one before it never goes into an earlier batch, and two open batches with the same sources and total are only tried
+*        once. the search stops after a fixed number of steps and keeps the best plan found
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+vector<int> Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::pack_mixed_remainder(const vector<int>& samples) {
+    int n = samples.size();
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return samples[a] > samples[b]; });
+    auto fits = [&](int sources, int total) { return total <= destination_room[BATCH_CAPACITY - sources]; };
+
+    //first-fit decreasing
+    vector<int> best(n, 0);
+    int best_batches = 0;
+    {
+        vector<int> sources;
+        vector<int> totals;
+        for (int k = 0; k < n; k++) {
+            int b = 0;
+            while (b < sources.size() && !(sources[b] < BATCH_CAPACITY - 1 && fits(sources[b] + 1, totals[b] + samples[order[k]]))) {
+                b++;
+            }
+            if (b == sources.size()) {
+                sources.push_back(0);
+                totals.push_back(0);
+            }
+            sources[b]++;
+            totals[b] += samples[order[k]];
+            best[order[k]] = b;
+        }
+        best_batches = sources.size();
+    }
+
+    //no plan can use fewer batches than the racks need, or than the samples need when every batch has one source and the most room
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += samples[i];
+    }
+    int lower_bound = 1;
+    while (lower_bound < best_batches
+        && (lower_bound * (BATCH_CAPACITY - 1) < n || lower_bound * destination_room[BATCH_CAPACITY - 1] < total)) {
+        lower_bound++;
+    }
+    if (best_batches <= lower_bound) {
+        return best;
+    }
+
+    vector<int> group_of(n, 0);
+    vector<int> sources;
+    vector<int> totals;
+    long long steps_left = 2000000;
+    auto search = [&](auto& self, int k) -> void {
+        if (best_batches == lower_bound || steps_left-- <= 0) {
+            return;
+        }
+        if (k == n) {
+            best_batches = sources.size();
+            best = group_of;
+            return;
+        }
+        int num_samples = samples[order[k]];
+        //a rack equal to the previous one goes in the same batch or a later one
+        int first = (k > 0 && samples[order[k - 1]] == num_samples) ? group_of[order[k - 1]] : 0;
+        for (int b = first; b < sources.size(); b++) {
+            if (sources[b] >= BATCH_CAPACITY - 1 || !fits(sources[b] + 1, totals[b] + num_samples)) {
+                continue;
+            }
+            bool repeat = false;
+            for (int c = first; c < b && !repeat; c++) {
+                repeat = sources[c] == sources[b] && totals[c] == totals[b];
+            }
+            if (repeat) {
+                continue;
+            }
+            sources[b]++;
+            totals[b] += num_samples;
+            group_of[order[k]] = b;
+            self(self, k + 1);
+            sources[b]--;
+            totals[b] -= num_samples;
+        }
+        if (sources.size() + 1 < best_batches) {
+            sources.push_back(1);
+            totals.push_back(num_samples);
+            group_of[order[k]] = sources.size() - 1;
+            self(self, k + 1);
+            sources.pop_back();
+            totals.pop_back();
+        }
+    };
+    search(search, 0);
+    return best;
+}
+
+#define INSTANTIATE_EXACT_BATCH(RACK_CAPACITY, BATCH_CAPACITY) \
+    template int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::choose_exact_num_sources(); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::create_exact_batch(int num_sources); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::compose_exact_batch(int num_sources); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::build_exact_table(int num_sources, int capacity); \
+    template int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::fullest_exact_total(int num_sources, int limit); \
+    template vector<int> Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::pack_remainder(const vector<int>& loads); \
+    template vector<int> Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::pack_mixed_remainder(const vector<int>& samples);
+RACK_FORMATS(INSTANTIATE_EXACT_BATCH)
@@ -0,0 +1,529 @@
+/*
+Local_Search.cpp
+Post-optimization pass for the Program class. Once distribute_racks has built finished_batches, improve_batches moves and swaps
+source racks between batches to empty out and delete weak batches and to free up destination racks. See Program.h header comment
+for more information on the Program class.
+
+A batch with s sources and a sample total of t is valid when s + ceil(t / RACK_CAPACITY) <= BATCH_CAPACITY, which is the same as
+t + s * RACK_CAPACITY <= BATCH_CAPACITY * RACK_CAPACITY. So each rack has a "load" of its sample number plus RACK_CAPACITY, a batch
+is valid exactly when its load fits in BATCH_CAPACITY * RACK_CAPACITY, and the room left in a batch (its slack) is a single number.
+Batches are kept in a set ordered by slack so the tightest batch a rack still fits in is found in O(log n).
+
+Any batch that is over BATCH_CAPACITY on the way in is repaired first, and every move after that keeps every batch valid. Some
+moves make the plan worse for a while (consolidating can add destination racks), so the best plan seen is kept on the side and
+stopping at any point returns it.
+*/
+
+#include <chrono>
+#include <set>
+#include <tuple>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include "Program.h"
+
+using namespace std;
+
+namespace {
+
+//working state of the local search: per-batch totals plus the two indices used to find a batch to move a rack into
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+struct Search_State {
+    using Batch = typename Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::Batch;
+
+    vector<Batch>& batches;
+    const Rack_Store<RACK_CAPACITY>& racks;
+    vector<int> sums;
+    vector<bool> removed;
+    //(slack, batch) for every live batch, slack being how much more load the batch can take and stay valid
+    set<pair<int, int>> by_slack;
+    //(free spots, batch) for live batches that could take one more source without needing another destination rack, free spots
+    //being the empty spots in the destination racks the batch already needs
+    set<pair<int, int>> by_free;
+
+    Search_State(vector<Batch>& batches, const Rack_Store<RACK_CAPACITY>& racks) : batches(batches), racks(racks) {}
+
+    static int load_of(int num_samples) { return num_samples + RACK_CAPACITY; }
+    int load(int b) const { return sums[b] + batches[b].batch_sources.size() * RACK_CAPACITY; }
+    int slack(int b) const { return BATCH_CAPACITY * RACK_CAPACITY - load(b); }
+    int destinations(int b) const { return (sums[b] + RACK_CAPACITY - 1) / RACK_CAPACITY; }
+    int free_spots(int b) const { return destinations(b) * RACK_CAPACITY - sums[b]; }
+
+    void index(int b) {
+        by_slack.insert({ slack(b), b });
+        if (batches[b].batch_sources.size() + destinations(b) < BATCH_CAPACITY) {
+            by_free.insert({ free_spots(b), b });
+        }
+    }
+
+    void unindex(int b) {
+        by_slack.erase({ slack(b), b });
+        by_free.erase({ free_spots(b), b });
+    }
+
+    void recompute(int b) {
+        sums[b] = 0;
+        for (int i = 0; i < batches[b].batch_sources.size(); i++) {
+            sums[b] += racks.samples(batches[b].batch_sources[i]);
+        }
+    }
+
+    //moves the rack at position pos of batch from to the end of batch to, keeping both indices current
+    void move_rack(int from, int pos, int to) {
+        unindex(from);
+        unindex(to);
+        vector<int>& sources = batches[from].batch_sources;
+        int rack = sources[pos];
+        sources[pos] = sources.back();
+        sources.pop_back();
+        sums[from] -= racks.samples(rack);
+        sums[to] += racks.samples(rack);
+        batches[to].batch_sources.push_back(rack);
+        index(from);
+        index(to);
+    }
+
+    //the tightest batch in index with at least need room, skipping the batches in exclude, or -1 if none
+    static int best_fit(const set<pair<int, int>>& index, int need, int exclude_1, int exclude_2) {
+        for (auto it = index.lower_bound({ need, -1 }); it != index.end(); it++) {
+            if (it->second != exclude_1 && it->second != exclude_2) {
+                return it->second;
+            }
+        }
+        return -1;
+    }
+};
+
+/*
+* name: repack
+* purpose: packs a pool of source racks into a given number of batches, filling each batch in turn with the subset of the racks
+*          left whose load comes closest to BATCH_CAPACITY * RACK_CAPACITY
+* arguments: the rack store, the racks to pack (indices into it), the number of batches to pack them into, and the vector to put the
+*            packed batches in
+* returns: true if every rack was packed
+* notes: each batch is a subset-sum over the sample numbers in the pool, solved with a bitset of reachable loads per sample number
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool repack(const Rack_Store<RACK_CAPACITY>& racks, const vector<int>& pool, int num_batches, vector<vector<int>>& packed) {
+    const int capacity = BATCH_CAPACITY * RACK_CAPACITY;
+    const int num_words = capacity / 64 + 1;
+
+    //racks still to pack, bucketed by sample number
+    array<vector<int>, RACK_CAPACITY + 1> left;
+    int num_left = pool.size();
+    for (int i = 0; i < pool.size(); i++) {
+        left[racks.samples(pool[i])].push_back(pool[i]);
+    }
+
+    packed.assign(num_batches, {});
+    for (int b = 0; b < num_batches && num_left > 0; b++) {
+        vector<int> values;
+        for (int num = 1; num <= RACK_CAPACITY; num++) {
+            if (!left[num].empty()) {
+                values.push_back(num);
+            }
+        }
+        //layers[t] is the bitset of loads reachable using only the first t sample numbers in values
+        vector<uint64_t> layers((values.size() + 1) * num_words, 0);
+        layers[0] = 1;
+        for (int t = 0; t < values.size(); t++) {
+            uint64_t* current = &layers[(t + 1) * num_words];
+            copy(&layers[t * num_words], &layers[(t + 1) * num_words], current);
+            int weight = values[t] + RACK_CAPACITY;
+            int copies = min((int)left[values[t]].size(), capacity / weight);
+            for (int piece = 1; copies > 0; piece *= 2) {
+                int take = min(piece, copies);
+                copies -= take;
+                shift_or(current, current, take * weight, num_words);
+            }
+        }
+
+        uint64_t* final_layer = &layers[values.size() * num_words];
+        int load = capacity;
+        while (!((final_layer[load / 64] >> (load % 64)) & 1)) {
+            load--;
+        }
+
+        //walk back from the largest sample number, taking as many of each as still leaves the rest reachable
+        for (int t = values.size() - 1; t >= 0; t--) {
+            uint64_t* previous = &layers[t * num_words];
+            int weight = values[t] + RACK_CAPACITY;
+            for (int count = min((int)left[values[t]].size(), load / weight); count >= 0; count--) {
+                int rest = load - count * weight;
+                if ((previous[rest / 64] >> (rest % 64)) & 1) {
+                    for (int i = 0; i < count; i++) {
+                        packed[b].push_back(left[values[t]].back());
+                        left[values[t]].pop_back();
+                    }
+                    num_left -= count;
+                    load = rest;
+                    break;
+                }
+            }
+        }
+    }
+    return num_left == 0;
+}
+
+}
+
+/*
+* name: improve_batches
+* purpose: improves finished_batches by moving and swapping source racks between batches until the time budget runs out, or until
+*          the plan reaches the lower bound and no more improving move is found
+* arguments: the wall-clock budget in seconds
+* returns: none
+* notes: first repairs any batch that is over BATCH_CAPACITY by moving racks out of it. then repeatedly tries to empty the weakest
+*        batches by moving each of their racks into the tightest batch it fits in, or by swapping it for a smaller rack that is
+*        moved on to a third batch, and to remove destination racks by moving a rack to a batch that has room for it in the
+*        destination racks it already needs. the random moves can always find something new, so while the plan is above
+*        batch_lower_bound, which is nearly always, the whole budget is used. it only stops early once the lower bound is reached
+*        and a whole sweep finds no improving move. does nothing with mixed destination formats
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::improve_batches(double seconds) {
+    RACK_TIME_PHASE(improve);
+    //every move below relies on a batch's room being linear in its number of sources, which only holds for a single format
+    if (mixed_destinations()) {
+        return;
+    }
+    auto deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    auto out_of_time = [&]() { return chrono::steady_clock::now() >= deadline; };
+
+    using Search_State = ::Search_State<RACK_CAPACITY, BATCH_CAPACITY>;
+    Search_State state(finished_batches, racks);
+    state.sums.assign(finished_batches.size(), 0);
+    state.removed.assign(finished_batches.size(), false);
+    for (int b = 0; b < finished_batches.size(); b++) {
+        state.recompute(b);
+        state.index(b);
+    }
+
+    //repair: move racks out of any batch that needs more than BATCH_CAPACITY racks, into an existing batch if one has room or
+    //into a new batch otherwise. this always runs to completion, the budget only limits the improvement loop
+    for (int b = 0; b < finished_batches.size(); b++) {
+        while (state.slack(b) < 0) {
+            vector<int>& sources = finished_batches[b].batch_sources;
+            //move the smallest rack that fixes the batch on its own, or the largest one if none does
+            int pos = max_element(sources.begin(), sources.end(), [&](int a, int c) {
+                return racks.samples(a) < racks.samples(c); }) - sources.begin();
+            for (int i = 0; i < sources.size(); i++) {
+                if (state.slack(b) + Search_State::load_of(racks.samples(sources[i])) >= 0
+                    && racks.samples(sources[i]) < racks.samples(sources[pos])) {
+                    pos = i;
+                }
+            }
+            int to = Search_State::best_fit(state.by_slack, Search_State::load_of(racks.samples(sources[pos])), b, b);
+            if (to == -1) {
+                Batch new_batch = {};
+                finished_batches.push_back(new_batch);
+                state.sums.push_back(0);
+                state.removed.push_back(false);
+                to = finished_batches.size() - 1;
+                state.index(to);
+            }
+            state.move_rack(b, pos, to);
+        }
+    }
+
+    //the plan without emptied batches, renumbered
+    auto compacted = [&]() {
+        vector<Batch> kept;
+        for (int b = 0; b < finished_batches.size(); b++) {
+            if (!state.removed[b] && !finished_batches[b].batch_sources.empty()) {
+                kept.push_back(finished_batches[b]);
+                kept.back().batch_num = kept.size();
+            }
+        }
+        return kept;
+    };
+    //(invalid batches, batches, destination racks) of the current plan, lower is better. ranked the same way as distribute_portfolio
+    //ranks its passes, so a plan with an over-capacity batch can never be kept over a valid one
+    auto score = [&]() {
+        int num_invalid = 0;
+        int num_batches = 0;
+        int num_destinations = 0;
+        for (int b = 0; b < finished_batches.size(); b++) {
+            if (!state.removed[b] && !finished_batches[b].batch_sources.empty()) {
+                num_invalid += state.slack(b) < 0;
+                num_batches++;
+                num_destinations += state.destinations(b);
+            }
+        }
+        return make_tuple(num_invalid, num_batches, num_destinations);
+    };
+
+    //consolidating can add destination racks for a while, so the best plan seen is kept separately and returned at the end
+    vector<Batch> best_plan = compacted();
+    tuple<int, int, int> best_score = score();
+
+    int live_batches = finished_batches.size();
+    //the large-neighborhood moves are random, so a sweep without an improvement only ends the search once the lower bound is
+    //reached and the deterministic moves have nothing left to do
+    bool improved = true;
+    while (!out_of_time() && (improved || live_batches > batch_lower_bound)) {
+        improved = false;
+
+        //try to empty batches, weakest (lowest load) first, as long as the plan is above the lower bound
+        vector<int> order;
+        for (int b = 0; b < finished_batches.size(); b++) {
+            if (!state.removed[b]) {
+                order.push_back(b);
+            }
+        }
+        stable_sort(order.begin(), order.end(), [&](int a, int c) { return state.load(a) < state.load(c); });
+
+        for (int k = 0; k < order.size() && live_batches > batch_lower_bound && !out_of_time(); k++) {
+            int x = order[k];
+            if (state.removed[x]) {
+                continue;
+            }
+
+            //remember every batch this attempt touches so it can be undone if some rack can't be placed
+            vector<pair<int, vector<int>>> saved;
+            auto save = [&](int b) {
+                for (int i = 0; i < saved.size(); i++) {
+                    if (saved[i].first == b) {
+                        return;
+                    }
+                }
+                saved.push_back({ b, finished_batches[b].batch_sources });
+            };
+            save(x);
+
+            //take racks out of x hardest first, i.e. the largest sample number
+            state.unindex(x);
+            sort(finished_batches[x].batch_sources.begin(), finished_batches[x].batch_sources.end(),
+                [&](int a, int c) { return racks.samples(a) < racks.samples(c); });
+            state.index(x);
+
+            bool emptied = true;
+            while (!finished_batches[x].batch_sources.empty()) {
+                int pos = finished_batches[x].batch_sources.size() - 1;
+                int num_samples = racks.samples(finished_batches[x].batch_sources[pos]);
+                int need = Search_State::load_of(num_samples);
+
+                //move: straight into the tightest batch with room
+                int y = Search_State::best_fit(state.by_slack, need, x, x);
+                if (y != -1) {
+                    save(y);
+                    state.move_rack(x, pos, y);
+                    continue;
+                }
+
+                //swap: put the rack into a batch y in place of a smaller rack q, and move q on to a third batch z. only the
+                //batches with the most slack are tried, since they need the smallest q
+                int swap_y = -1;
+                int swap_q = -1;
+                int swap_z = -1;
+                int tries = 0;
+                for (auto it = state.by_slack.rbegin(); it != state.by_slack.rend() && tries < 32 && swap_y == -1; it++, tries++) {
+                    int y_try = it->second;
+                    if (y_try == x) {
+                        continue;
+                    }
+                    vector<int>& y_sources = finished_batches[y_try].batch_sources;
+                    for (int q = 0; q < y_sources.size(); q++) {
+                        int q_samples = racks.samples(y_sources[q]);
+                        if (q_samples >= num_samples || state.slack(y_try) + Search_State::load_of(q_samples) < need) {
+                            continue;
+                        }
+                        int z = Search_State::best_fit(state.by_slack, Search_State::load_of(q_samples), x, y_try);
+                        if (z != -1) {
+                            swap_y = y_try;
+                            swap_q = q;
+                            swap_z = z;
+                            break;
+                        }
+                    }
+                }
+                bool swapped = swap_y != -1;
+                if (swapped) {
+                    save(swap_y);
+                    save(swap_z);
+                    state.move_rack(swap_y, swap_q, swap_z);
+                    state.move_rack(x, pos, swap_y);
+                }
+                if (!swapped) {
+                    emptied = false;
+                    break;
+                }
+            }
+
+            if (emptied) {
+                state.unindex(x);
+                state.removed[x] = true;
+                live_batches--;
+                improved = true;
+            }
+            else {
+                //undo every move made in this attempt
+                for (int i = 0; i < saved.size(); i++) {
+                    state.unindex(saved[i].first);
+                }
+                for (int i = 0; i < saved.size(); i++) {
+                    finished_batches[saved[i].first].batch_sources = move(saved[i].second);
+                    state.recompute(saved[i].first);
+                    state.index(saved[i].first);
+                }
+            }
+        }
+
+        //consolidate: move load out of the weakest batch into heavier ones, directly or by swapping one of its racks for a smaller
+        //rack from a heavier batch. each move concentrates free room in the weakest batch, which is what emptying it needs
+        if (live_batches > batch_lower_bound) {
+            int x = -1;
+            for (int b = 0; b < finished_batches.size(); b++) {
+                if (!state.removed[b] && (x == -1 || state.load(b) < state.load(x))) {
+                    x = b;
+                }
+            }
+            bool moved = true;
+            while (x != -1 && moved && !finished_batches[x].batch_sources.empty() && !out_of_time()) {
+                moved = false;
+                for (int pos = 0; pos < finished_batches[x].batch_sources.size() && !moved; pos++) {
+                    int num_samples = racks.samples(finished_batches[x].batch_sources[pos]);
+                    int need = Search_State::load_of(num_samples);
+                    int y = Search_State::best_fit(state.by_slack, need, x, x);
+                    if (y != -1) {
+                        state.move_rack(x, pos, y);
+                        moved = true;
+                        break;
+                    }
+
+                    int swap_y = -1;
+                    int swap_q = -1;
+                    int tries = 0;
+                    for (auto it = state.by_slack.rbegin(); it != state.by_slack.rend() && tries < 32 && swap_y == -1; it++, tries++) {
+                        int y_try = it->second;
+                        if (y_try == x || state.load(y_try) < state.load(x)) {
+                            continue;
+                        }
+                        vector<int>& y_sources = finished_batches[y_try].batch_sources;
+                        for (int q = 0; q < y_sources.size(); q++) {
+                            int q_samples = racks.samples(y_sources[q]);
+                            if (q_samples < num_samples && state.slack(y_try) + Search_State::load_of(q_samples) >= need) {
+                                swap_y = y_try;
+                                swap_q = q;
+                                break;
+                            }
+                        }
+                    }
+                    if (swap_y != -1) {
+                        //the rack lands at the end of swap_y, so swap_q still points at the smaller rack
+                        state.move_rack(x, pos, swap_y);
+                        state.move_rack(swap_y, swap_q, x);
+                        moved = true;
+                    }
+                }
+                improved = improved || moved;
+            }
+            if (x != -1 && finished_batches[x].batch_sources.empty()) {
+                state.unindex(x);
+                state.removed[x] = true;
+                live_batches--;
+            }
+        }
+
+        //large neighborhood: take the weakest batch together with enough other batches that their combined slack could hold it,
+        //picked at random with a bias toward the ones with the most slack, and try to repack all of their racks into one batch
+        //fewer, each batch filled as tightly as possible
+        vector<int> live;
+        for (int b = 0; b < finished_batches.size(); b++) {
+            if (!state.removed[b]) {
+                live.push_back(b);
+            }
+        }
+        int weakest = live.empty() ? -1 : *min_element(live.begin(), live.end(), [&](int a, int c) { return state.load(a) < state.load(c); });
+        for (int attempt = 0; attempt < 16 && live.size() > 2 && live_batches > batch_lower_bound && !out_of_time(); attempt++) {
+            //even attempts go through the batches from most slack to least, odd attempts in a random order
+            vector<int> candidates;
+            for (auto it = state.by_slack.rbegin(); it != state.by_slack.rend(); it++) {
+                candidates.push_back(it->second);
+            }
+            if (attempt % 2 == 1) {
+                shuffle(candidates.begin(), candidates.end(), rng);
+            }
+            vector<int> group = { weakest };
+            int group_slack = 0;
+            //with a little extra slack so the repacking has some room to work with
+            for (int i = 0; i < candidates.size() && group_slack < state.load(weakest) + RACK_CAPACITY; i++) {
+                int b = candidates[i];
+                if (b != weakest && uniform_int_distribution<int>(0, 3)(rng) != 0) {
+                    group.push_back(b);
+                    group_slack += state.slack(b);
+                }
+            }
+            if (group_slack < state.load(weakest) || group.size() < 2) {
+                break;
+            }
+
+            vector<int> pool;
+            for (int i = 0; i < group.size(); i++) {
+                pool.insert(pool.end(), finished_batches[group[i]].batch_sources.begin(), finished_batches[group[i]].batch_sources.end());
+            }
+            vector<vector<int>> packed;
+            if (!repack<RACK_CAPACITY, BATCH_CAPACITY>(racks, pool, group.size() - 1, packed)) {
+                continue;
+            }
+
+            for (int i = 0; i < group.size(); i++) {
+                state.unindex(group[i]);
+            }
+            //the last batch of the group is always emptied, and the repacking can fill the pool in fewer batches than it was
+            //given, so every batch of the group left empty is removed
+            for (int j = 0; j < group.size(); j++) {
+                vector<int>& sources = finished_batches[group[j]].batch_sources;
+                if (j < packed.size()) {
+                    sources = move(packed[j]);
+                }
+                else {
+                    sources.clear();
+                }
+                state.recompute(group[j]);
+                if (sources.empty()) {
+                    state.removed[group[j]] = true;
+                    live.erase(find(live.begin(), live.end(), group[j]));
+                    live_batches--;
+                }
+                else {
+                    state.index(group[j]);
+                }
+            }
+            improved = true;
+            weakest = *min_element(live.begin(), live.end(), [&](int a, int c) { return state.load(a) < state.load(c); });
+        }
+
+        //raise destination fill: move a rack out of a batch when that lets the batch drop a destination rack, into a batch that
+        //can hold it without needing another one
+        for (int a = 0; a < finished_batches.size() && !out_of_time(); a++) {
+            if (state.removed[a]) {
+                continue;
+            }
+            for (int pos = 0; pos < finished_batches[a].batch_sources.size(); pos++) {
+                int num_samples = racks.samples(finished_batches[a].batch_sources[pos]);
+                if (state.sums[a] - num_samples > (state.destinations(a) - 1) * RACK_CAPACITY) {
+                    continue;
+                }
+                int b = Search_State::best_fit(state.by_free, num_samples, a, a);
+                if (b == -1) {
+                    continue;
+                }
+                state.move_rack(a, pos, b);
+                improved = true;
+                break;
+            }
+        }
+
+        if (score() < best_score) {
+            best_plan = compacted();
+            best_score = score();
+        }
+    }
+
+    finished_batches = move(best_plan);
+}
+
+#define INSTANTIATE_LOCAL_SEARCH(RACK_CAPACITY, BATCH_CAPACITY) \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::improve_batches(double seconds);
+RACK_FORMATS(INSTANTIATE_LOCAL_SEARCH)
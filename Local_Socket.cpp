@@ -0,0 +1,442 @@
+/*
+Local_Socket.cpp
+Stream connections over a local (Unix domain) socket path. See Local_Socket.h header comment for more information.
+*/
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "Local_Socket.h"
+
+using namespace std;
+
+#ifdef _WIN32
+using Socket = SOCKET;
+#else
+using Socket = int;
+#endif
+
+//a peer that has gone away must show up as a failed send, not as SIGPIPE
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+/*
+* name: start_sockets
+* purpose: starts Winsock the first time a socket is needed
+* arguments: none
+* returns: true if sockets can be used
+* notes: does nothing on POSIX systems
+*/
+static bool start_sockets() {
+#ifdef _WIN32
+    static bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+#else
+    return true;
+#endif
+}
+
+/*
+* name: no_sigpipe
+* purpose: sets a socket not to raise SIGPIPE when the other side has gone, on systems that do it per socket
+* arguments: the socket
+* returns: none
+* notes: does nothing where sends use MSG_NOSIGNAL instead
+*/
+static void no_sigpipe([[maybe_unused]] intptr_t handle) {
+#if !defined(_WIN32) && defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt((Socket)handle, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+/*
+* name: new_socket
+* purpose: creates a local stream socket
+* arguments: none
+* returns: the socket, -1 if it couldn't be created
+* notes: none
+*/
+static intptr_t new_socket() {
+    if (!start_sockets()) {
+        return -1;
+    }
+    Socket created = socket(AF_UNIX, SOCK_STREAM, 0);
+#ifdef _WIN32
+    if (created == INVALID_SOCKET) {
+        return -1;
+    }
+#else
+    if (created == -1) {
+        return -1;
+    }
+#endif
+    no_sigpipe((intptr_t)created);
+    return (intptr_t)created;
+}
+
+/*
+* name: close_socket
+* purpose: closes a socket
+* arguments: the socket
+* returns: none
+* notes: none
+*/
+static void close_socket(intptr_t handle) {
+#ifdef _WIN32
+    closesocket((Socket)handle);
+#else
+    ::close((Socket)handle);
+#endif
+}
+
+/*
+* name: interrupted
+* purpose: checks whether the last socket call was only interrupted by a signal and should be retried
+* arguments: none
+* returns: true if it should be retried
+* notes: none
+*/
+static bool interrupted() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEINTR;
+#else
+    return errno == EINTR;
+#endif
+}
+
+/*
+* name: make_address
+* purpose: fills in the socket address for a path
+* arguments: the path, the address to fill in, and a string that is set to a description of the problem if the path can't be used
+* returns: true if the path fits in an address
+* notes: none
+*/
+static bool make_address(const string& path, sockaddr_un& address, string& error) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        error = "socket path " + path + " must be 1 to " + to_string(sizeof(address.sun_path) - 1) + " characters";
+        return false;
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+    return true;
+}
+
+/*
+* name: wait_readable
+* purpose: waits until a socket has data or a connection to take
+* arguments: the socket and the longest wait in milliseconds, -1 to wait for ever
+* returns: 1 when it is readable, 0 when the wait ran out, -1 if waiting failed
+* notes: none
+*/
+static int wait_readable(intptr_t handle, int timeout_ms) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET((Socket)handle, &readable);
+    timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    int ready = select((int)handle + 1, &readable, nullptr, nullptr, timeout_ms < 0 ? nullptr : &timeout);
+    return ready > 0 ? 1 : ready;
+}
+
+Local_Connection& Local_Connection::operator=(Local_Connection&& other) noexcept {
+    if (this != &other) {
+        close();
+        handle = other.handle;
+        other.handle = -1;
+    }
+    return *this;
+}
+
+/*
+* name: connect
+* purpose: connects to a server listening on a socket path
+* arguments: the path, and a string that is set to a description of the problem if there is no server
+* returns: true if connected
+* notes: any connection already held is closed first
+*/
+bool Local_Connection::connect(const string& path, string& error) {
+    close();
+    sockaddr_un address;
+    if (!make_address(path, address, error)) {
+        return false;
+    }
+    handle = new_socket();
+    if (handle == -1) {
+        error = "could not create a socket";
+        return false;
+    }
+    if (::connect((Socket)handle, (const sockaddr*)&address, sizeof(address)) != 0) {
+        error = "no server is listening on " + path;
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+* name: read_all
+* purpose: reads everything the other side writes until it shuts down its writing
+* arguments: the string to append the data to, the most seconds to wait for more data (0 for no limit), and a string that is set
+*            to a description of the problem if the read fails
+* returns: true if the other side finished writing
+* notes: none
+*/
+bool Local_Connection::read_all(string& data, int timeout_seconds, string& error) {
+    vector<char> buffer(1 << 20);
+    while (true) {
+        int ready = wait_readable(handle, timeout_seconds > 0 ? timeout_seconds * 1000 : -1);
+        if (ready == 0) {
+            error = "timed out waiting for the rest of the message";
+            return false;
+        }
+        if (ready < 0) {
+            if (interrupted()) {
+                continue;
+            }
+            error = "the connection failed";
+            return false;
+        }
+        int received = recv((Socket)handle, buffer.data(), (int)buffer.size(), 0);
+        if (received == 0) {
+            return true;
+        }
+        if (received < 0) {
+            if (interrupted()) {
+                continue;
+            }
+            error = "the connection failed";
+            return false;
+        }
+        data.append(buffer.data(), received);
+    }
+}
+
+/*
+* name: read_group
+* purpose: reads everything each connection of a group writes until it shuts down its writing, waiting on all of them together
+* arguments: the connections, the strings set to the data each one sent and to a description of the problem if its read fails
+*            (empty if it didn't), and the most seconds to wait for the whole group (0 for no limit)
+* returns: none
+* notes: the connections still being read when the time runs out all fail with a timeout
+*/
+void Local_Connection::read_group(vector<Local_Connection>& connections, vector<string>& data, vector<string>& errors, int timeout_seconds) {
+    data.assign(connections.size(), string());
+    errors.assign(connections.size(), string());
+    vector<int> reading;
+    for (int i = 0; i < connections.size(); i++) {
+        reading.push_back(i);
+    }
+    vector<char> buffer(1 << 20);
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(timeout_seconds);
+    while (!reading.empty()) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        intptr_t highest = 0;
+        for (int i : reading) {
+            FD_SET((Socket)connections[i].handle, &readable);
+            highest = max(highest, connections[i].handle);
+        }
+        long long timeout_ms = 0;
+        if (timeout_seconds > 0) {
+            timeout_ms = max(0LL, (long long)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count());
+        }
+        timeval timeout;
+        timeout.tv_sec = (long)(timeout_ms / 1000);
+        timeout.tv_usec = (long)(timeout_ms % 1000) * 1000;
+        int ready = select((int)highest + 1, &readable, nullptr, nullptr, timeout_seconds > 0 ? &timeout : nullptr);
+        if (ready < 0 && interrupted()) {
+            continue;
+        }
+        if (ready <= 0) {
+            for (int i : reading) {
+                errors[i] = ready == 0 ? "timed out waiting for the rest of the message" : "the connection failed";
+            }
+            return;
+        }
+
+        vector<int> still_reading;
+        for (int i : reading) {
+            if (!FD_ISSET((Socket)connections[i].handle, &readable)) {
+                still_reading.push_back(i);
+                continue;
+            }
+            int received = recv((Socket)connections[i].handle, buffer.data(), (int)buffer.size(), 0);
+            if (received > 0) {
+                data[i].append(buffer.data(), received);
+                still_reading.push_back(i);
+            }
+            else if (received < 0) {
+                if (interrupted()) {
+                    still_reading.push_back(i);
+                }
+                else {
+                    errors[i] = "the connection failed";
+                }
+            }
+        }
+        reading = move(still_reading);
+    }
+}
+
+/*
+* name: write_all
+* purpose: writes all of a message
+* arguments: the message
+* returns: true if it was all written, false if the other side has gone
+* notes: none
+*/
+bool Local_Connection::write_all(string_view data) {
+    while (!data.empty()) {
+        int chunk = (int)min<size_t>(data.size(), 1 << 20);
+        int sent = send((Socket)handle, data.data(), chunk, SEND_FLAGS);
+        if (sent < 0 && interrupted()) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix(sent);
+    }
+    return true;
+}
+
+/*
+* name: finish_writing
+* purpose: shuts down the writing side, so the other side's read_all returns
+* arguments: none
+* returns: none
+* notes: none
+*/
+void Local_Connection::finish_writing() {
+#ifdef _WIN32
+    shutdown((Socket)handle, SD_SEND);
+#else
+    shutdown((Socket)handle, SHUT_WR);
+#endif
+}
+
+/*
+* name: close
+* purpose: closes the connection
+* arguments: none
+* returns: none
+* notes: safe to call when not connected
+*/
+void Local_Connection::close() {
+    if (handle != -1) {
+        close_socket(handle);
+    }
+    handle = -1;
+}
+
+/*
+* name: open
+* purpose: starts listening on a socket path
+* arguments: the path, and a string that is set to a description of the problem if it can't be listened on
+* returns: true if listening
+* notes: a socket file nobody is listening on is left behind by a server that stopped without closing, and is replaced
+*/
+bool Local_Listener::open(const string& path, string& error) {
+    close();
+    sockaddr_un address;
+    if (!make_address(path, address, error)) {
+        return false;
+    }
+    Local_Connection probe;
+    string probe_error;
+    if (probe.connect(path, probe_error)) {
+        error = "a server is already listening on " + path;
+        return false;
+    }
+    remove(path.c_str());
+
+    handle = new_socket();
+    if (handle == -1) {
+        error = "could not create a socket";
+        return false;
+    }
+    if (bind((Socket)handle, (const sockaddr*)&address, sizeof(address)) != 0 || listen((Socket)handle, SOMAXCONN) != 0) {
+        error = "could not listen on " + path;
+        close_socket(handle);
+        handle = -1;
+        return false;
+    }
+    bound_path = path;
+    return true;
+}
+
+/*
+* name: accept_group
+* purpose: takes the connections that arrive together
+* arguments: the longest gap in milliseconds between two connections of one group, and the most connections in a group
+* returns: the connections, empty only if the listener failed
+* notes: blocks until the first connection arrives
+*/
+vector<Local_Connection> Local_Listener::accept_group(int window_ms, int max_connections) {
+    vector<Local_Connection> group;
+    while (group.size() < max_connections) {
+        int ready = wait_readable(handle, group.empty() ? -1 : window_ms);
+        if (ready < 0 && interrupted()) {
+            continue;
+        }
+        if (ready <= 0) {
+            break;
+        }
+        Socket accepted = accept((Socket)handle, nullptr, nullptr);
+#ifdef _WIN32
+        bool failed = accepted == INVALID_SOCKET;
+#else
+        bool failed = accepted == -1;
+#endif
+        if (failed) {
+            if (interrupted()) {
+                continue;
+            }
+            break;
+        }
+        no_sigpipe((intptr_t)accepted);
+        group.emplace_back((intptr_t)accepted);
+    }
+    return group;
+}
+
+/*
+* name: close
+* purpose: stops listening and removes the socket file
+* arguments: none
+* returns: none
+* notes: safe to call when not listening
+*/
+void Local_Listener::close() {
+    if (handle != -1) {
+        close_socket(handle);
+        remove(bound_path.c_str());
+    }
+    handle = -1;
+    bound_path.clear();
+}
@@ -0,0 +1,79 @@
+/*
+Local_Socket.h: stream connections over a local (Unix domain) socket path, for the planning server and its client.
+
+Uses AF_UNIX sockets, which POSIX systems have and Windows has since Windows 10 1803 (afunix.h), so nothing is ever reachable
+over the network. Each Local_Connection carries one request and its reply: the client writes the request and shuts down its
+side, the server reads up to that point, writes the reply and closes, and the client reads the reply up to the close.
+
+*/
+
+#ifndef LOCAL_SOCKET_H
+#define LOCAL_SOCKET_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+class Local_Connection {
+public:
+	Local_Connection() {}
+	explicit Local_Connection(intptr_t handle) : handle(handle) {}
+	~Local_Connection() { close(); }
+
+	//a connection has one owner, but can be handed on
+	Local_Connection(const Local_Connection&) = delete;
+	Local_Connection& operator=(const Local_Connection&) = delete;
+	Local_Connection(Local_Connection&& other) noexcept : handle(other.handle) { other.handle = -1; }
+	Local_Connection& operator=(Local_Connection&& other) noexcept;
+
+	//connect to a server listening on path, returns false and sets error if there is none
+	bool connect(const string& path, string& error);
+
+	//read everything until the other side shuts down its writing, giving up after timeout_seconds without any data (0 waits
+	//for ever). returns false and sets error if the connection fails or times out
+	bool read_all(string& data, int timeout_seconds, string& error);
+
+	//read_all for a group of connections at once, so a slow one holds up the rest for no longer than timeout_seconds in all.
+	//data[i] is what connections[i] sent, and errors[i] is empty if it finished writing or says why not. a group can have up to
+	//FD_SETSIZE connections, 64 on Windows
+	static void read_group(vector<Local_Connection>& connections, vector<string>& data, vector<string>& errors, int timeout_seconds);
+
+	//write all of data, returns false if the other side has gone
+	bool write_all(string_view data);
+
+	//tell the other side nothing more will be written, the connection stays open for reading
+	void finish_writing();
+	void close();
+
+private:
+	intptr_t handle = -1;
+};
+
+class Local_Listener {
+public:
+	Local_Listener() {}
+	~Local_Listener() { close(); }
+
+	Local_Listener(const Local_Listener&) = delete;
+	Local_Listener& operator=(const Local_Listener&) = delete;
+
+	//listen on path, replacing a socket file left there by a server that is no longer running. returns false and sets error if
+	//the path is too long, already in use by a running server or can't be bound
+	bool open(const string& path, string& error);
+
+	//waits for a connection, then keeps taking connections while each arrives within window_ms of the one before, up to
+	//max_connections in all
+	vector<Local_Connection> accept_group(int window_ms, int max_connections);
+
+	//stops listening and removes the socket file
+	void close();
+
+private:
+	intptr_t handle = -1;
+	string bound_path;
+};
+
+#endif
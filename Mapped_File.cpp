@@ -0,0 +1,119 @@
+/*
+Mapped_File.cpp
+Read-only memory map of a whole file. See Mapped_File.h header comment for more information.
+*/
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <string>
+#include "Mapped_File.h"
+
+using namespace std;
+
+/*
+* name: open
+* purpose: maps a whole file into memory for reading
+* arguments: the path of the file, and a string that is set to a description of the problem if the file can't be mapped
+* returns: true if the file is mapped (an empty file counts, with data() null and size() 0)
+* notes: any mapping already held is released first
+*/
+bool Mapped_File::open(const string& path, string& error) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "could not open " + path;
+        return false;
+    }
+    file_handle = file;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        error = "could not read the size of " + path;
+        close();
+        return false;
+    }
+    length = (size_t)file_size.QuadPart;
+    if (length == 0) {
+        return true;
+    }
+    mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr) {
+        error = "could not map " + path;
+        close();
+        return false;
+    }
+    contents = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (contents == nullptr) {
+        error = "could not map " + path;
+        close();
+        return false;
+    }
+#else
+    file_descriptor = ::open(path.c_str(), O_RDONLY);
+    if (file_descriptor == -1) {
+        error = "could not open " + path;
+        return false;
+    }
+    struct stat file_info;
+    if (fstat(file_descriptor, &file_info) != 0 || !S_ISREG(file_info.st_mode)) {
+        error = "could not read the size of " + path;
+        close();
+        return false;
+    }
+    length = (size_t)file_info.st_size;
+    if (length == 0) {
+        return true;
+    }
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (mapped == MAP_FAILED) {
+        error = "could not map " + path;
+        close();
+        return false;
+    }
+    //the file is read front to back once
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    contents = (const char*)mapped;
+#endif
+    return true;
+}
+
+/*
+* name: close
+* purpose: releases the mapping and the file
+* arguments: none
+* returns: none
+* notes: safe to call when nothing is mapped
+*/
+void Mapped_File::close() {
+#ifdef _WIN32
+    if (contents != nullptr) {
+        UnmapViewOfFile(contents);
+    }
+    if (mapping_handle != nullptr) {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr) {
+        CloseHandle(file_handle);
+    }
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (contents != nullptr) {
+        munmap((void*)contents, length);
+    }
+    if (file_descriptor != -1) {
+        ::close(file_descriptor);
+    }
+    file_descriptor = -1;
+#endif
+    contents = nullptr;
+    length = 0;
+}
@@ -0,0 +1,45 @@
+/*
+Mapped_File.h: read-only memory map of a whole file.
+
+Used by Program::read_file so large rack files are parsed in place instead of being copied through an ifstream. Uses mmap on
+POSIX systems and CreateFileMapping on Windows. The mapping is released when the Mapped_File is destroyed.
+
+*/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+class Mapped_File {
+public:
+	Mapped_File() {}
+	~Mapped_File() { close(); }
+
+	//a mapping can't be shared between two owners
+	Mapped_File(const Mapped_File&) = delete;
+	Mapped_File& operator=(const Mapped_File&) = delete;
+
+	//map the file at path, returns false and sets error if it can't be opened or mapped
+	bool open(const string& path, string& error);
+	void close();
+
+	//the file contents, data() is null for an empty file
+	const char* data() const { return contents; }
+	size_t size() const { return length; }
+
+private:
+	const char* contents = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#else
+	int file_descriptor = -1;
+#endif
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*
+Online.cpp
+Online intake for the Program class. Racks are added one line at a time as they come off intake, and a batch is taken out as soon
+as one can be made that fills enough of its destination racks, instead of waiting for the whole input. See Program.h header
+comment for more information on the Program class.
+
+sample_frequencies, available_mask and source_buckets are kept up to date with every rack added, so the usual batch builders run
+unchanged on whatever has arrived so far. A candidate batch is composed in the testing array and measured, then either taken with
+finalize_spots or released with rollback_testing, so a batch that isn't full enough yet costs nothing but the time to compose it.
+*/
+
+#include <string>
+#include <string_view>
+#include "Program.h"
+
+using namespace std;
+
+/*
+* name: add_rack_line
+* purpose: adds the rack on one line of rack data to the undistributed racks
+* arguments: the line, without its newline, and a string that is set to a description of the problem if the line is bad
+* returns: true if the line was read (blank lines are skipped), false if it is malformed or its sample number is out of range
+* notes: same line format as read_buffer. the rack is available to the next emit_ready_batches right away
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::add_rack_line(string_view line, string& error) {
+    string_view id;
+    int num_samples;
+    if (!parse_rack_line(line.data(), line.data() + line.size(), RACK_CAPACITY, id, num_samples, error)) {
+        return false;
+    }
+    if (num_samples == 0) {
+        return true;
+    }
+    if (!racks.add(id, num_samples)) {
+        error = "rack ids take up more than 4 GB";
+        return false;
+    }
+    source_buckets[num_samples].push_back(racks.size() - 1);
+    sources_remaining++;
+    increment_frequency(num_samples);
+    return true;
+}
+
+/*
+* name: batch_spots
+* purpose: counts the spots in the destination racks a batch with the given sample total would use
+* arguments: the sample total of the batch
+* returns: the number of destination spots, 0 if no batch can hold that many samples
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::batch_spots(int total) {
+    if (!mixed_destinations()) {
+        int num_destinations = destinations_for(total);
+        return num_destinations > BATCH_CAPACITY ? 0 : num_destinations * RACK_CAPACITY;
+    }
+    vector<int> mix = destination_mix(total);
+    int spots = 0;
+    for (int f = 0; f < mix.size(); f++) {
+        spots += mix[f] * destination_formats[f].capacity;
+    }
+    return spots;
+}
+
+/*
+* name: take_online_batch
+* purpose: makes the next batch from the racks waiting if it fits and fills at least min_fill of its destination spots
+* arguments: the fraction (0 to 1) of its destination spots the batch must fill
+* returns: true if a batch was added to the end of get_batches
+* notes: the batch is composed the same way distribute_racks does (heuristic or exact mode). a heuristic batch that doesn't fit or
+*        isn't full enough is released and the exact solver is tried instead, since the racks left behind by earlier batches are
+*        often the kind the heuristic's backup overfills
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::take_online_batch(double min_fill) {
+    for (int attempt = exact_mode ? 1 : 0; attempt < 2; attempt++) {
+        bool exact = attempt == 1;
+        int num_sources;
+        {
+            RACK_TIME_PHASE(choose);
+            num_sources = exact ? choose_exact_num_sources() : choose_num_sources();
+        }
+        {
+            RACK_TIME_PHASE(create);
+            if (exact) {
+                compose_exact_batch(num_sources);
+            }
+            else {
+                compose_new_batch(num_sources);
+            }
+            fit_testing();
+        }
+
+        //the batch must fit and fill enough of the destination racks it needs
+        int total = testing_array.sum();
+        int spots = batch_spots(total);
+        if (spots > 0 && testing_array.size() + destinations_for(total) <= BATCH_CAPACITY && total >= min_fill * spots) {
+            finished_batches.push_back(finalize_spots());
+#ifndef NDEBUG
+            check_frequencies();
+#endif
+            return true;
+        }
+        rollback_testing(0);
+    }
+    return false;
+}
+
+/*
+* name: emit_ready_batches
+* purpose: takes out every batch that can already be made from the racks added so far and fills at least online_fill of its
+*          destination spots
+* arguments: none
+* returns: the number of batches added to the end of get_batches
+* notes: tries while more than BATCH_CAPACITY - 1 racks are waiting, like distribute_racks. once no batch is full enough the racks
+*        wait for more to arrive
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::emit_ready_batches() {
+    int emitted = 0;
+    while (sources_remaining > BATCH_CAPACITY - 1 && take_online_batch(online_fill)) {
+        emitted++;
+    }
+    return emitted;
+}
+
+/*
+* name: flush_online
+* purpose: plans every rack still waiting once the input has ended, however full the batches are
+* arguments: none
+* returns: none
+* notes: batches are taken with take_online_batch while more than BATCH_CAPACITY - 1 racks are left, then distribute_racks plans the
+*        rest, so the last of them go through distribute_remainder. the lower bound is recomputed over every rack added, the ones
+*        already in emitted batches included
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::flush_online() {
+    array<int, RACK_CAPACITY + 1> read_frequencies{};
+    for (int i = 0; i < racks.size(); i++) {
+        read_frequencies[racks.samples(i)]++;
+    }
+    while (sources_remaining > BATCH_CAPACITY - 1 && take_online_batch(0)) {
+    }
+    distribute_racks();
+    batch_lower_bound = compute_lower_bound(read_frequencies);
+}
+
+#define INSTANTIATE_ONLINE(RACK_CAPACITY, BATCH_CAPACITY) \
+    template bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::add_rack_line(string_view line, string& error); \
+    template int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::batch_spots(int total); \
+    template bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::take_online_batch(double min_fill); \
+    template int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::emit_ready_batches(); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::flush_online();
+RACK_FORMATS(INSTANTIATE_ONLINE)
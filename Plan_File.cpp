@@ -0,0 +1,191 @@
+/*
+Plan_File.cpp
+Writing and reading the compact binary plan format. See Plan_File.h header comment for the layout.
+*/
+
+#include <cstring>
+#include <vector>
+#include "Program.h"
+#include "Plan_File.h"
+#include "Buffered_Writer.h"
+
+using namespace std;
+
+namespace {
+    //rounds a byte offset up to the next 8-byte boundary
+    uint64_t align_8(uint64_t offset) {
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    //writes zero bytes until the writer is at offset
+    void pad_to(Buffered_Writer& writer, uint64_t& position, uint64_t offset) {
+        const char zeros[8] = {};
+        writer.bytes(zeros, offset - position);
+        position = offset;
+    }
+}
+
+/*
+* name: write_plan_file
+* purpose: writes the finished batches in the binary plan format
+* arguments: the stream to write to, which should be opened in binary mode
+* returns: none
+* notes: the columns are streamed through a Buffered_Writer batch by batch, so only the header is built up front
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_plan_file(ostream& out) {
+    RACK_TIME_PHASE(write);
+    Plan_File_Header header = {};
+    memcpy(header.magic, PLAN_FILE_MAGIC, sizeof(header.magic));
+    header.version = PLAN_FILE_VERSION;
+    header.header_size = sizeof(Plan_File_Header);
+    header.rack_capacity = RACK_CAPACITY;
+    header.batch_capacity = BATCH_CAPACITY;
+    header.num_batches = finished_batches.size();
+    header.lower_bound = batch_lower_bound;
+    for (int b = 0; b < finished_batches.size(); b++) {
+        header.num_racks += finished_batches[b].batch_sources.size();
+        for (int i = 0; i < finished_batches[b].batch_sources.size(); i++) {
+            header.id_arena_size += racks.id(finished_batches[b].batch_sources[i]).size();
+        }
+    }
+    header.batch_starts_offset = align_8(sizeof(Plan_File_Header));
+    header.batch_totals_offset = align_8(header.batch_starts_offset + 4 * (header.num_batches + 1));
+    header.rack_indices_offset = align_8(header.batch_totals_offset + 4 * header.num_batches);
+    header.rack_counts_offset = align_8(header.rack_indices_offset + 4 * header.num_racks);
+    header.id_offsets_offset = align_8(header.rack_counts_offset + sizeof(typename Racks::Count) * header.num_racks);
+    header.id_arena_offset = align_8(header.id_offsets_offset + 4 * (header.num_racks + 1));
+
+    Buffered_Writer writer(out);
+    uint64_t position = 0;
+    writer.bytes(&header, sizeof(header));
+    position += sizeof(header);
+
+    //one pass over the batches per column
+    pad_to(writer, position, header.batch_starts_offset);
+    uint32_t start = 0;
+    for (int b = 0; b <= finished_batches.size(); b++) {
+        writer.bytes(&start, 4);
+        if (b < finished_batches.size()) {
+            start += finished_batches[b].batch_sources.size();
+        }
+    }
+    position += 4 * (header.num_batches + 1);
+
+    pad_to(writer, position, header.batch_totals_offset);
+    for (int b = 0; b < finished_batches.size(); b++) {
+        uint32_t total = batch_total(finished_batches[b]);
+        writer.bytes(&total, 4);
+    }
+    position += 4 * header.num_batches;
+
+    pad_to(writer, position, header.rack_indices_offset);
+    for (int b = 0; b < finished_batches.size(); b++) {
+        for (int i = 0; i < finished_batches[b].batch_sources.size(); i++) {
+            uint32_t rack = finished_batches[b].batch_sources[i];
+            writer.bytes(&rack, 4);
+        }
+    }
+    position += 4 * header.num_racks;
+
+    pad_to(writer, position, header.rack_counts_offset);
+    for (int b = 0; b < finished_batches.size(); b++) {
+        for (int i = 0; i < finished_batches[b].batch_sources.size(); i++) {
+            typename Racks::Count count = racks.samples(finished_batches[b].batch_sources[i]);
+            writer.bytes(&count, sizeof(count));
+        }
+    }
+    position += sizeof(typename Racks::Count) * header.num_racks;
+
+    pad_to(writer, position, header.id_offsets_offset);
+    uint32_t id_offset = 0;
+    writer.bytes(&id_offset, 4);
+    for (int b = 0; b < finished_batches.size(); b++) {
+        for (int i = 0; i < finished_batches[b].batch_sources.size(); i++) {
+            id_offset += racks.id(finished_batches[b].batch_sources[i]).size();
+            writer.bytes(&id_offset, 4);
+        }
+    }
+    position += 4 * (header.num_racks + 1);
+
+    pad_to(writer, position, header.id_arena_offset);
+    for (int b = 0; b < finished_batches.size(); b++) {
+        for (int i = 0; i < finished_batches[b].batch_sources.size(); i++) {
+            writer.text(racks.id(finished_batches[b].batch_sources[i]));
+        }
+    }
+    writer.flush();
+    out.flush();
+}
+
+/*
+* name: open
+* purpose: checks that a buffer holds a plan file this version can read and points the view at it
+* arguments: the data (usually a Mapped_File) and its size, and a string that is set to a description of the problem
+* returns: true if the header and every column check out
+* notes: besides the header, batch_starts and id_offsets are checked to start at 0, never decrease and end at num_racks and
+*        id_arena_size, so every batch range and rack id the view hands out lies inside its column. one pass over each
+*/
+bool Plan_File_View::open(const char* file_data, size_t size, string& error) {
+    data = nullptr;
+    if (size < sizeof(Plan_File_Header)) {
+        error = "too short to be a plan file";
+        return false;
+    }
+    const Plan_File_Header& file_header = *(const Plan_File_Header*)file_data;
+    if (memcmp(file_header.magic, PLAN_FILE_MAGIC, sizeof(file_header.magic)) != 0) {
+        error = "not a plan file";
+        return false;
+    }
+    if (file_header.version != PLAN_FILE_VERSION || file_header.header_size != sizeof(Plan_File_Header)) {
+        error = "plan file version " + to_string(file_header.version) + " is not supported";
+        return false;
+    }
+
+    //a rack count this large would overflow the column sizes below, and can't fit in the file anyway
+    if (file_header.num_racks > size || file_header.id_arena_size > size) {
+        error = "plan file is truncated or corrupt";
+        return false;
+    }
+
+    //(offset, size) of every column
+    uint64_t columns[6][2] = {
+        { file_header.batch_starts_offset, 4 * (uint64_t(file_header.num_batches) + 1) },
+        { file_header.batch_totals_offset, 4 * uint64_t(file_header.num_batches) },
+        { file_header.rack_indices_offset, 4 * file_header.num_racks },
+        { file_header.rack_counts_offset, (file_header.rack_capacity > UINT8_MAX ? 2 : 1) * file_header.num_racks },
+        { file_header.id_offsets_offset, 4 * (file_header.num_racks + 1) },
+        { file_header.id_arena_offset, file_header.id_arena_size },
+    };
+    for (int c = 0; c < 6; c++) {
+        if (columns[c][0] % 8 != 0 || columns[c][0] > size || columns[c][1] > size - columns[c][0]) {
+            error = "plan file is truncated or corrupt";
+            return false;
+        }
+    }
+    data = file_data;
+
+    //both offset columns must run from 0 up to the end of what they index without going back
+    auto runs_up_to = [](const uint32_t* offsets, uint64_t count, uint64_t end) {
+        if (offsets[0] != 0 || offsets[count] != end) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            if (offsets[i] > offsets[i + 1]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    const uint32_t* id_offsets = (const uint32_t*)(data + file_header.id_offsets_offset);
+    if (!runs_up_to(batch_starts(), num_batches(), num_racks()) || !runs_up_to(id_offsets, num_racks(), file_header.id_arena_size)) {
+        data = nullptr;
+        error = "plan file is truncated or corrupt";
+        return false;
+    }
+    return true;
+}
+
+#define INSTANTIATE_PLAN_FILE(RACK_CAPACITY, BATCH_CAPACITY) \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_plan_file(ostream& out);
+RACK_FORMATS(INSTANTIATE_PLAN_FILE)
@@ -0,0 +1,84 @@
+/*
+Plan_File.h: compact binary plan format.
+
+A plan file is a Plan_File_Header followed by columns of fixed-width little-endian integers, each starting on an 8-byte boundary at
+the offset the header gives. Batches are stored as ranges of plan positions (batch b holds positions batch_starts[b] to
+batch_starts[b + 1] - 1), and every plan position has the read-order index, the sample number and the id of its rack. A downstream
+tool can memory-map the file (see Mapped_File.h) and use Plan_File_View to read the columns in place instead of parsing the csv.
+
+*/
+
+#ifndef PLAN_FILE_H
+#define PLAN_FILE_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+static_assert(endian::native == endian::little, "plan files are written in the byte order of the machine, which must be little-endian");
+
+struct Plan_File_Header {
+	//"RACKPLAN"
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t rack_capacity;
+	uint32_t batch_capacity;
+	uint32_t num_batches;
+	int32_t lower_bound;
+	//racks in the plan
+	uint64_t num_racks;
+	uint64_t id_arena_size;
+
+	//byte offsets of the columns from the start of the file
+	//uint32[num_batches + 1], first plan position of each batch plus the end
+	uint64_t batch_starts_offset;
+	//uint32[num_batches], sample total of each batch
+	uint64_t batch_totals_offset;
+	//uint32[num_racks], index of each rack in the order it was read in
+	uint64_t rack_indices_offset;
+	//uint8[num_racks] (uint16 when rack_capacity is above 255), sample number of each rack
+	uint64_t rack_counts_offset;
+	//uint32[num_racks + 1], the id of the rack at position i is id_arena[id_offsets[i], id_offsets[i + 1])
+	uint64_t id_offsets_offset;
+	//char[id_arena_size]
+	uint64_t id_arena_offset;
+};
+
+const char PLAN_FILE_MAGIC[8] = { 'R', 'A', 'C', 'K', 'P', 'L', 'A', 'N' };
+const uint32_t PLAN_FILE_VERSION = 1;
+
+//read-only view of a plan file held in memory, the data must outlive the view
+class Plan_File_View {
+public:
+	//checks the header, that every column lies inside the data and that the batch and id offsets run in order, returns false and
+	//sets error if not
+	bool open(const char* data, size_t size, string& error);
+
+	const Plan_File_Header& header() const { return *(const Plan_File_Header*)data; }
+	int num_batches() const { return header().num_batches; }
+	size_t num_racks() const { return header().num_racks; }
+
+	const uint32_t* batch_starts() const { return (const uint32_t*)(data + header().batch_starts_offset); }
+	const uint32_t* batch_totals() const { return (const uint32_t*)(data + header().batch_totals_offset); }
+	const uint32_t* rack_indices() const { return (const uint32_t*)(data + header().rack_indices_offset); }
+	//bytes per entry of the rack_counts column
+	int count_width() const { return header().rack_capacity > UINT8_MAX ? 2 : 1; }
+	int rack_count(size_t pos) const {
+		const char* counts = data + header().rack_counts_offset;
+		return count_width() == 1 ? ((const uint8_t*)counts)[pos] : ((const uint16_t*)counts)[pos];
+	}
+	string_view rack_id(size_t pos) const {
+		const uint32_t* offsets = (const uint32_t*)(data + header().id_offsets_offset);
+		return string_view(data + header().id_arena_offset + offsets[pos], offsets[pos + 1] - offsets[pos]);
+	}
+
+private:
+	const char* data = nullptr;
+};
+
+#endif
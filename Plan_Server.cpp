@@ -0,0 +1,194 @@
+/*
+Plan_Server.cpp
+Long-running planning server over a local socket, and the client call for it. See Plan_Server.h header comment for more information.
+*/
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Plan_Server.h"
+#include "Local_Socket.h"
+
+using namespace std;
+
+/*
+* name: status_line
+* purpose: makes the status line that starts the reply to a request that succeeded
+* arguments: the plan the reply is about and the number of batches the request's delta changed
+* returns: the line, with its newline
+* notes: none
+*/
+template <class Planner>
+static string status_line(Planner& program, int changed) {
+    return "OK batches=" + to_string(program.get_num_batches()) + " lower_bound=" + to_string(program.get_lower_bound())
+        + " changed=" + to_string(changed) + "\n";
+}
+
+/*
+* name: render_results
+* purpose: writes the results csv of a plan into memory
+* arguments: the plan
+* returns: the csv
+* notes: none
+*/
+template <class Planner>
+static string render_results(Planner& program) {
+    ostringstream out;
+    program.write_results(out);
+    return move(out).str();
+}
+
+/*
+* name: serve_plans
+* purpose: answers PLAN, WHATIF, DELTA and STOP requests on a local socket from one warm plan
+* arguments: the finished plan to serve, the options for PLAN requests that bring racks, where and how to listen, the stream to
+*            log each group of requests to, and a string that is set to a description of the problem if serving fails
+* returns: true once a STOP request has been answered, false if the socket can't be listened on or stops accepting connections
+* notes: the requests of a group are read together, then handled one at a time in arrival order. PLAN and DELTA replies wait
+*        until the end of the group (or until a PLAN brings racks and replaces the warm plan), so they all share one csv of the warm
+*        plan with every delta of the group applied. a WHATIF applies its delta to the warm plan in a trial and takes it back after
+*        replying, which only copies the batches the delta changes
+*/
+template <class Planner>
+bool serve_plans(Planner& program, const Plan_Options& options, const Server_Options& server, ostream& log, string& error) {
+    Local_Listener listener;
+    if (!listener.open(server.socket_path, error)) {
+        return false;
+    }
+    program.index_plan();
+    log << "serving a plan of " << program.get_num_batches() << " batches on " << server.socket_path << endl;
+
+    //csv of the warm plan, rendered again only once the plan has changed
+    string results;
+    bool results_current = false;
+
+    bool stopping = false;
+    while (!stopping) {
+        vector<Local_Connection> group = listener.accept_group(server.group_window_ms, server.max_group);
+        if (group.empty()) {
+            error = "stopped accepting connections on " + server.socket_path;
+            return false;
+        }
+        auto start = chrono::steady_clock::now();
+
+        //PLAN and DELTA requests waiting for the warm plan's csv: the connection, and the batches the request's delta changed
+        vector<pair<int, int>> waiting;
+        auto answer_waiting = [&]() {
+            if (waiting.empty()) {
+                return;
+            }
+            if (!results_current) {
+                results = render_results(program);
+                results_current = true;
+            }
+            for (auto [connection, changed] : waiting) {
+                group[connection].write_all(status_line(program, changed));
+                group[connection].write_all(results);
+                group[connection].close();
+            }
+            waiting.clear();
+        };
+        auto answer_error = [&](int connection, const string& message) {
+            group[connection].write_all("ERROR " + message + "\n");
+            group[connection].close();
+        };
+
+        vector<string> requests;
+        vector<string> read_errors;
+        Local_Connection::read_group(group, requests, read_errors, server.read_timeout_seconds);
+        for (int i = 0; i < group.size(); i++) {
+            if (!read_errors[i].empty()) {
+                answer_error(i, read_errors[i]);
+                continue;
+            }
+            const string& request = requests[i];
+            size_t command_end = request.find('\n');
+            string command = request.substr(0, command_end);
+            command.erase(command.find_last_not_of(" \t\r") + 1);
+            string_view data = command_end == string::npos ? string_view() : string_view(request).substr(command_end + 1);
+
+            if (command == "PLAN") {
+                if (data.find_first_not_of(" \t\r\n") != string_view::npos) {
+                    Planner fresh;
+                    fresh.set_read_threads(options.num_threads);
+                    string plan_error;
+                    if (!fresh.read_buffer(data.data(), data.size(), plan_error) || !run_plan(fresh, options, plan_error)) {
+                        answer_error(i, plan_error);
+                        continue;
+                    }
+                    //the requests before this one get the plan it replaces
+                    answer_waiting();
+                    program = move(fresh);
+                    program.index_plan();
+                    results_current = false;
+                }
+                waiting.push_back({ i, 0 });
+            }
+            else if (command == "DELTA") {
+                istringstream delta{ string(data) };
+                string delta_error;
+                if (!program.apply_delta(delta, delta_error)) {
+                    answer_error(i, delta_error);
+                    continue;
+                }
+                results_current = false;
+                waiting.push_back({ i, program.get_num_changed() });
+            }
+            else if (command == "WHATIF") {
+                istringstream delta{ string(data) };
+                string delta_error;
+                program.begin_trial();
+                if (program.apply_delta(delta, delta_error)) {
+                    group[i].write_all(status_line(program, program.get_num_changed()));
+                    group[i].write_all(render_results(program));
+                    group[i].close();
+                }
+                else {
+                    answer_error(i, delta_error);
+                }
+                program.end_trial();
+            }
+            else if (command == "STOP") {
+                group[i].write_all(status_line(program, 0));
+                group[i].close();
+                stopping = true;
+            }
+            else {
+                answer_error(i, "unknown request " + command + ", expected PLAN, WHATIF, DELTA or STOP");
+            }
+        }
+        answer_waiting();
+        log << "answered " << group.size() << (group.size() == 1 ? " request" : " requests") << " in "
+            << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    }
+    listener.close();
+    return true;
+}
+
+/*
+* name: send_plan_request
+* purpose: sends one request to a planning server and reads its reply
+* arguments: the server's socket path, the request (command line and data), the string the reply is appended to, and a string
+*            that is set to a description of the problem if the server can't be reached
+* returns: true if the whole reply was read, whatever its status
+* notes: the request is sent in full before the reply is read, which is the order the server reads and answers in
+*/
+bool send_plan_request(const string& socket_path, const string& request, string& reply, string& error) {
+    Local_Connection connection;
+    if (!connection.connect(socket_path, error)) {
+        return false;
+    }
+    if (!connection.write_all(request)) {
+        error = "the server closed the connection";
+        return false;
+    }
+    connection.finish_writing();
+    return connection.read_all(reply, 0, error);
+}
+
+#define INSTANTIATE_PLAN_SERVER(RACK_CAPACITY, BATCH_CAPACITY) \
+    template bool serve_plans(Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>& program, const Plan_Options& options, \
+        const Server_Options& server, ostream& log, string& error);
+RACK_FORMATS(INSTANTIATE_PLAN_SERVER)
@@ -0,0 +1,54 @@
+/*
+Plan_Server.h: long-running planning server over a local socket, and the client call for it.
+
+serve_plans keeps one finished plan warm (its racks, id index and histogram stay loaded) and answers requests on a local socket
+path (see Local_Socket.h), so benches and scripts don't pay for starting a process, parsing the input and planning on every call.
+A request is a command line followed by its data, and the connection is shut down for writing once it is sent:
+
+    PLAN                  the results csv of the warm plan
+    PLAN + rack lines     plan these racks from scratch, keep the plan as the warm plan and reply with its csv
+    WHATIF + delta lines  the csv the warm plan would have after the delta (see Replan.cpp), leaving the warm plan as it was
+    DELTA + delta lines   apply the delta to the warm plan and reply with its csv
+    STOP                  reply and stop serving
+
+The reply starts with one status line, "OK batches=<n> lower_bound=<n> changed=<n>" followed by the csv, or "ERROR <message>",
+and the server closes the connection when it is done. Requests that arrive within the group window of each other are read
+together and handled in arrival order, and the PLAN and DELTA replies of a group wait for the end of it and share one csv of the warm plan
+with all of the group's deltas applied, so a burst of requests renders the plan once.
+
+A rack a DELTA removes stays in the warm plan's rack store and id index until removed racks are more than half of it, when
+apply_delta compacts both (see compact_racks in Replan.cpp), so a server that only ever takes deltas stays within about twice the
+memory of its live racks and never needs a restart to free it.
+
+*/
+
+#ifndef PLAN_SERVER_H
+#define PLAN_SERVER_H
+
+#include <iostream>
+#include <string>
+#include "Rack_Planner.h"
+
+using namespace std;
+
+//where and how serve_plans listens
+struct Server_Options {
+	//the socket path to listen on
+	string socket_path;
+	//longest gap in milliseconds between two requests of one group, and the most requests in a group
+	int group_window_ms = 2;
+	int max_group = 64;
+	//seconds the clients of a group have, together, to send their requests before the ones not done are answered with an error
+	int read_timeout_seconds = 2;
+};
+
+//serve requests for the finished plan in program until a STOP request, writing one line per group of requests to log. options are
+//used for PLAN requests that bring racks. returns false and sets error if the socket can't be listened on
+template <class Planner>
+bool serve_plans(Planner& program, const Plan_Options& options, const Server_Options& server, ostream& log, string& error);
+
+//send one request (the command line and its data) to the server on socket_path and read the whole reply. returns false and sets
+//error if the server can't be reached or the connection fails, a reply with an ERROR status still returns true
+bool send_plan_request(const string& socket_path, const string& request, string& reply, string& error);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+Portfolio.cpp
+Multi-start portfolio for the Program class. Runs many varied passes of distribute_racks on a pool of threads and keeps the best
+plan. See Program.h header comment for more information on the Program class.
+
+Each pass works on its own copy of the Program's histogram, rack buckets, testing array and batches, so nothing a pass changes is
+shared between threads. The Rack_Store, which holds every rack id and is by far the largest part of a Program, is not copied: it is
+moved out of the Program for the run and every pass reads the sample numbers from that one copy (see rack_samples).
+Passes are ranked by a total order that ends with the pass number, so the plan kept depends only on the seed and the number of
+passes, never on which thread ran which pass or in what order they finished.
+*/
+
+#include <thread>
+#include <atomic>
+#include <tuple>
+#include <vector>
+#include "Program.h"
+
+using namespace std;
+
+/*
+* name: better_plan
+* purpose: decides whether one finished pass beats another
+* arguments: the two Programs after distribute_racks and the pass number each came from
+* returns: true if a beats b
+* notes: fewer invalid batches first, then fewer batches, then fewer destination racks (fuller destinations), then the lower pass
+*        number so that ties are broken the same way every run
+*/
+template <class Planner>
+static bool better_plan(Planner& a, int pass_a, Planner& b, int pass_b) {
+    return make_tuple(a.count_invalid_batches(), a.get_num_batches(), a.get_total_destinations(), pass_a)
+         < make_tuple(b.count_invalid_batches(), b.get_num_batches(), b.get_total_destinations(), pass_b);
+}
+
+/*
+* name: distribute_portfolio
+* purpose: distributes all the source racks by running several passes of distribute_racks and keeping the best plan
+* arguments: the number of passes to run, the number of threads to run them on, and the seed for the randomized passes
+* returns: none
+* notes: pass 0 runs the configured mode unchanged and pass 1 runs the other mode (exact or heuristic), so the result is never
+*        worse than either. every later pass runs the heuristic with add_ratios randomized from a seed derived from the seed and
+*        the pass number. the racks are handed to the kept pass at the end, so no pass ever copies them
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::distribute_portfolio(int num_passes, int num_threads, unsigned seed) {
+    num_passes = max(num_passes, 1);
+    num_threads = max(1, min(num_threads, num_passes));
+
+    //the passes only read sample numbers, so they share these instead of each copying the rack ids
+    Racks all_racks = move(racks);
+    racks = Racks();
+
+    atomic<int> next_pass(0);
+    //best plan found by each thread and the pass it came from (-1 until the thread finishes a pass)
+    vector<Basic_Program> thread_best(num_threads);
+    vector<int> thread_best_pass(num_threads, -1);
+
+    auto worker = [&](int thread_num) {
+        while (true) {
+            int pass = next_pass++;
+            if (pass >= num_passes) {
+                return;
+            }
+
+            //each pass gets its own copy of the histogram and rack buckets
+            Basic_Program attempt = *this;
+            attempt.shared_racks = &all_racks;
+            if (pass == 1) {
+                attempt.exact_mode = !exact_mode;
+            }
+            else if (pass > 1) {
+                attempt.exact_mode = false;
+                attempt.randomized = true;
+                seed_seq pass_seed = { seed, (unsigned)pass };
+                attempt.rng.seed(pass_seed);
+            }
+            attempt.distribute_racks();
+
+            if (thread_best_pass[thread_num] == -1 || better_plan(attempt, pass, thread_best[thread_num], thread_best_pass[thread_num])) {
+                thread_best[thread_num] = move(attempt);
+                thread_best_pass[thread_num] = pass;
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < num_threads; t++) {
+        threads.push_back(thread(worker, t));
+    }
+    worker(0);
+    for (int t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    //keep the best plan across all threads
+    int best_thread = -1;
+    for (int t = 0; t < num_threads; t++) {
+        if (thread_best_pass[t] == -1) {
+            continue;
+        }
+        if (best_thread == -1 || better_plan(thread_best[t], thread_best_pass[t], thread_best[best_thread], thread_best_pass[best_thread])) {
+            best_thread = t;
+        }
+    }
+    Basic_Program& best = thread_best[best_thread];
+    best.racks = move(all_racks);
+    best.shared_racks = nullptr;
+    *this = move(best);
+}
+
+#define INSTANTIATE_PORTFOLIO(RACK_CAPACITY, BATCH_CAPACITY) \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::distribute_portfolio(int num_passes, int num_threads, unsigned seed);
+RACK_FORMATS(INSTANTIATE_PORTFOLIO)
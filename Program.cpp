@@ -5,22 +5,30 @@ Implementation of the Program class. See comments within this file or Program.h
 
 #include <iostream>
 #include <fstream>
+#include <charconv>
+#include <cstring>
+#include <iterator>
 #include <string>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <thread>
 #include "Program.h"
+#include "Mapped_File.h"
+#include "Buffered_Writer.h"
 
 using namespace std;
 
 /*
 * name: read_data
-* purpose: Prompts users to provide a file for rack data, creates a new Source Rack object for each line, and pushes them back to
-           the all_sources vector.
+* purpose: Prompts users to provide a file for rack data and adds the rack on each line to the Rack_Store.
 * arguments: none
 * returns: none
 * notes: rack data file must contain a new line for every Source Rack, represented by a rack id, followed by a space and an int sample
          number. Ex. SAMPLEid1 23
 */
-void Program::read_data() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_data() {
     string filename;
     cout << "This is the Rack Distribution Program, please enter the name of a txt data file (must include .txt extension at end of name):" << endl;
     cin >> filename;
@@ -32,34 +40,227 @@ void Program::read_data() {
         cin >> filename;
         infile.open("inputs/" + filename);
     }
-    while (!infile.eof()) {
-        Source_Rack current_source;
-        infile >> current_source.id;
-        infile >> current_source.num_samples;
-        //check if both id and num_samples were successfully read
-        if (!infile) {
-            break;  //exit the loop if the read fails
+    infile.close();
+    string error;
+    if (!read_file("inputs/" + filename, error)) {
+        cerr << "Error reading " << filename << ": " << error << endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+* name: read_file
+* purpose: reads rack data from a file by mapping it into memory and parsing it in place
+* arguments: the path of the file, and a string that is set to a description of the problem if it can't be read
+* returns: true if every line was read
+* notes: see read_buffer
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_file(const string& path, string& error) {
+    Mapped_File file;
+    if (!file.open(path, error)) {
+        return false;
+    }
+    return read_buffer(file.data(), file.size(), error);
+}
+
+/*
+* name: read_stream
+* purpose: reads rack data from a stream
+* arguments: the stream to read from, and a string that is set to a description of the problem if the data is bad
+* returns: true if every line was read
+* notes: reads the whole stream into memory and then parses it with read_buffer, so streams and files accept the same lines
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_stream(istream& in, string& error) {
+    string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return read_buffer(contents.data(), contents.size(), error);
+}
+
+namespace {
+    //racks parsed from one newline-aligned piece of the input by one thread
+    template <int RACK_CAPACITY>
+    struct Parsed_Chunk {
+        Rack_Store<RACK_CAPACITY> racks;
+        //indices into racks, bucketed by sample number like source_buckets
+        array<deque<int>, RACK_CAPACITY + 1> buckets;
+        //lines in the chunk, or up to and including the bad line
+        int num_lines = 0;
+        //problem with line num_lines of the chunk, empty if every line was read
+        string error;
+    };
+
+    /*
+    * name: parse_chunk
+    * purpose: parses the racks in [data, end), which starts at the beginning of a line
+    * arguments: the range to parse and the chunk to fill
+    * returns: none
+    * notes: stops at the first bad line, leaving its message in chunk.error and its number in chunk.num_lines
+    */
+    template <int RACK_CAPACITY>
+    void parse_chunk(const char* data, const char* end, Parsed_Chunk<RACK_CAPACITY>& chunk) {
+        //count the lines first so the racks grow once
+        size_t num_lines = 0;
+        for (const char* p = data; p < end; p++) {
+            p = (const char*)memchr(p, '\n', end - p);
+            if (p == nullptr) {
+                break;
+            }
+            num_lines++;
         }
-        all_sources.push_back(current_source);
+        chunk.racks.reserve(num_lines + 1, end - data);
+
+        const char* line = data;
+        while (line < end) {
+            chunk.num_lines++;
+            const char* line_end = (const char*)memchr(line, '\n', end - line);
+            if (line_end == nullptr) {
+                line_end = end;
+            }
+
+            string_view id;
+            int num_samples;
+            if (!parse_rack_line(line, line_end, RACK_CAPACITY, id, num_samples, chunk.error)) {
+                return;
+            }
+            if (num_samples > 0) {
+                chunk.buckets[num_samples].push_back(chunk.racks.size());
+                if (!chunk.racks.add(id, num_samples)) {
+                    chunk.error = "rack ids take up more than 4 GB";
+                    return;
+                }
+            }
+            line = line_end + 1;
+        }
+    }
+}
+
+/*
+* name: read_buffer
+* purpose: parses rack data held in memory, adding the rack on each line to the Rack_Store
+* arguments: the data and its size in bytes, and a string that is set to a description of the problem if the data is bad
+* returns: true if every line was read, false if a line is malformed or has a sample number outside 1 to RACK_CAPACITY
+* notes: same line format as read_data: a rack id, spaces or tabs, then the sample number. blank lines are skipped and anything after
+*        the sample number is ignored. large inputs are split into newline-aligned chunks parsed on read_threads threads, each
+*        with its own racks and buckets. the chunks are then merged in file order, so racks, source_buckets and the line
+*        number of the first bad line are exactly what a serial read gives. nothing is printed, so this is safe to call from the
+*        headless planner (Rack_Planner.h)
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_buffer(const char* data, size_t size, string& error) {
+    RACK_TIME_PHASE(load);
+    const char* end = data + size;
+
+    //below about a megabyte per thread the threads cost more than they save
+    const size_t min_chunk_size = 1 << 20;
+    size_t num_chunks = max<size_t>(1, min<size_t>(read_threads, size / min_chunk_size));
+
+    //chunk c covers [bounds[c], bounds[c + 1]), each boundary moved forward to just after a newline
+    vector<const char*> bounds(num_chunks + 1, end);
+    bounds[0] = data;
+    for (size_t c = 1; c < num_chunks; c++) {
+        const char* guess = max(data + size / num_chunks * c, bounds[c - 1]);
+        const char* newline = (const char*)memchr(guess, '\n', end - guess);
+        bounds[c] = newline == nullptr ? end : newline + 1;
+    }
+
+    vector<Parsed_Chunk<RACK_CAPACITY>> chunks(num_chunks);
+    vector<thread> threads;
+    for (size_t c = 1; c < num_chunks; c++) {
+        threads.push_back(thread(parse_chunk<RACK_CAPACITY>, bounds[c], bounds[c + 1], ref(chunks[c])));
+    }
+    parse_chunk(bounds[0], bounds[1], chunks[0]);
+    for (int t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    //the first bad line in file order wins, numbered from the start of the whole input
+    int lines_before = 0;
+    for (size_t c = 0; c < num_chunks; c++) {
+        if (!chunks[c].error.empty()) {
+            error = "line " + to_string(lines_before + chunks[c].num_lines) + ": " + chunks[c].error;
+            return false;
+        }
+        lines_before += chunks[c].num_lines;
+    }
+
+    //on a fresh Program the first chunk's racks and buckets are taken over as they are, its indices already match
+    size_t first_copied = 0;
+    if (racks.empty()) {
+        racks = move(chunks[0].racks);
+        source_buckets.swap(chunks[0].buckets);
+        first_copied = 1;
     }
 
+    //where each remaining chunk's racks and ids start in racks
+    vector<int> offsets(num_chunks + 1, racks.size());
+    vector<size_t> arena_offsets(num_chunks + 1, racks.id_arena.size());
+    for (size_t c = first_copied; c < num_chunks; c++) {
+        offsets[c + 1] = offsets[c] + chunks[c].racks.size();
+        arena_offsets[c + 1] = arena_offsets[c] + chunks[c].racks.id_arena.size();
+    }
+    if (arena_offsets[num_chunks] > UINT32_MAX) {
+        error = "rack ids take up more than 4 GB";
+        return false;
+    }
+    sources_remaining += offsets[num_chunks] - (first_copied == 1 ? 0 : offsets[0]);
+    if (first_copied == num_chunks) {
+        return true;
+    }
+    racks.id_arena.resize(arena_offsets[num_chunks]);
+    racks.id_offsets.resize(offsets[num_chunks] + 1);
+    racks.counts.resize(offsets[num_chunks]);
+
+    //merge in parallel: thread t copies chunk t's racks into place, then appends its share of the sample numbers to source_buckets
+    //from every chunk in order, so each bucket still lists its racks in read order
+    auto merge = [&](size_t t) {
+        if (t >= first_copied) {
+            const Racks& chunk_racks = chunks[t].racks;
+            copy(chunk_racks.id_arena.begin(), chunk_racks.id_arena.end(), racks.id_arena.begin() + arena_offsets[t]);
+            copy(chunk_racks.counts.begin(), chunk_racks.counts.end(), racks.counts.begin() + offsets[t]);
+            for (int i = 0; i < chunk_racks.size(); i++) {
+                racks.id_offsets[offsets[t] + i + 1] = arena_offsets[t] + chunk_racks.id_offsets[i + 1];
+            }
+        }
+        for (int num = 1 + t; num <= RACK_CAPACITY; num += num_chunks) {
+            for (size_t c = first_copied; c < num_chunks; c++) {
+                for (int i = 0; i < chunks[c].buckets[num].size(); i++) {
+                    source_buckets[num].push_back(offsets[c] + chunks[c].buckets[num][i]);
+                }
+            }
+        }
+    };
+    threads.clear();
+    for (size_t t = 1; t < num_chunks; t++) {
+        threads.push_back(thread(merge, t));
+    }
+    merge(0);
+    for (int t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    return true;
 }
 
 /*
 * name: populate_frequencies
-* purpose: iterates through the all_sources vector and updates the sample_frequencies hash map based on the number of sources with that
-           number of samples
+* purpose: updates the sample_frequencies hash map based on the number of undistributed sources with each number of samples
 * arguments: none
 * returns: none
-* notes: none
+* notes: only needs to run once after reading, batch creation keeps sample_frequencies up to date as racks are reserved and taken
 */
-void Program::populate_frequencies() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::populate_frequencies() {
+    RACK_TIME_PHASE(populate);
     //clear array
     for (int i = 0; i < sample_frequencies.size(); i++) {
         sample_frequencies[i] = 0;
     }
-    for (int i = 0; i < all_sources.size(); i++) {
-        sample_frequencies[all_sources.at(i).num_samples]++;
+    available_mask = Sample_Mask<RACK_CAPACITY>();
+    for (int i = 1; i < source_buckets.size(); i++) {
+        sample_frequencies[i] = source_buckets[i].size();
+        if (sample_frequencies[i] > 0) {
+            available_mask.set(i);
+        }
     }
 
 }
@@ -71,48 +272,382 @@ void Program::populate_frequencies() {
 * returns: none
 * notes: none
 */
-void Program::distribute_racks() {
-    while (all_sources.size() > 19) {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::distribute_racks() {
+    batch_lower_bound = compute_lower_bound(sample_frequencies);
+
+    while (sources_remaining > BATCH_CAPACITY - 1) {
         //choose the number of sources for the current batch
-        int num_sources = choose_num_sources();
-        //create_new_batch(num_sources, example_testing_array);
-        create_new_batch(num_sources);
+        int num_sources;
+        {
+            RACK_TIME_PHASE(choose);
+            num_sources = exact_mode ? choose_exact_num_sources() : choose_num_sources();
+        }
+        {
+            RACK_TIME_PHASE(create);
+            if (exact_mode) {
+                create_exact_batch(num_sources);
+            }
+            else {
+                create_new_batch(num_sources);
+            }
+        }
+#ifndef NDEBUG
+        check_frequencies();
+#endif
+    }
+    //once BATCH_CAPACITY - 1 or fewer are left, pack the rest with distribute_remainder
+    {
+        RACK_TIME_PHASE(remainder);
+        distribute_remainder();
+    }
+#ifndef NDEBUG
+    check_frequencies();
+#endif
+}
+
+/*
+* name: compute_lower_bound
+* purpose: computes a lower bound on the number of batches needed for a set of racks
+* arguments: the number of racks with each sample number, e.g. sample_frequencies for the undistributed racks
+* returns: the lower bound
+* notes: a batch with d destination racks holds at most (BATCH_CAPACITY - d) sources and at most destination_room[d] samples. the
+*        bound is the optimum of the linear relaxation that picks a fractional number of batches of each d so that there is room
+*        for every rack and every sample, rounded up. an optimal solution mixes at most two values of d, so every single d and
+*        every pair are tried
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::compute_lower_bound(const array<int, RACK_CAPACITY + 1>& frequencies) {
+    double num_racks = 0;
+    double num_samples = 0;
+    for (int i = 1; i < frequencies.size(); i++) {
+        num_racks += frequencies[i];
+        num_samples += (double)i * frequencies[i];
+    }
+    if (num_racks == 0) {
+        return 0;
+    }
+
+    double best = 1e18;
+    for (int d1 = 1; d1 < BATCH_CAPACITY; d1++) {
+        //only batches with d1 destinations, as many as the tighter of the two constraints needs
+        double rack_room_1 = BATCH_CAPACITY - d1;
+        double sample_room_1 = destination_room[d1];
+        best = min(best, max(num_racks / rack_room_1, num_samples / sample_room_1));
+
+        //x1 batches with d1 destinations and x2 with d2, with both constraints tight
+        for (int d2 = d1 + 1; d2 < BATCH_CAPACITY; d2++) {
+            double rack_room_2 = BATCH_CAPACITY - d2;
+            double sample_room_2 = destination_room[d2];
+            double det = rack_room_1 * sample_room_2 - rack_room_2 * sample_room_1;
+            double x1 = (num_racks * sample_room_2 - rack_room_2 * num_samples) / det;
+            double x2 = (rack_room_1 * num_samples - num_racks * sample_room_1) / det;
+            if (x1 >= 0 && x2 >= 0) {
+                best = min(best, x1 + x2);
+            }
+        }
+    }
+    //small tolerance so rounding error on an exact integer optimum doesn't add a batch
+    return (int)ceil(best - 1e-9);
+}
+
+/*
+* name: optimality_gap
+* purpose: how far the current plan is above the lower bound, as a percentage of the lower bound
+* arguments: none
+* returns: the gap in percent, 0 if the lower bound is 0
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+double Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::optimality_gap() {
+    if (batch_lower_bound == 0) {
+        return 0;
+    }
+    return 100.0 * ((double)finished_batches.size() - batch_lower_bound) / batch_lower_bound;
+}
+
+/*
+* name: batch_total
+* purpose: adds up the samples in every source rack of a Batch
+* arguments: the Batch
+* returns: the number of samples the batch puts into its destination racks
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::batch_total(const Batch& batch) {
+    int total = 0;
+    for (int i = 0; i < batch.batch_sources.size(); i++) {
+        total += rack_samples(batch.batch_sources[i]);
+    }
+    return total;
+}
+
+/*
+* name: batch_destinations
+* purpose: finds the number of destination racks a Batch needs
+* arguments: the Batch
+* returns: the number of destination racks
+* notes: see destinations_for
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::batch_destinations(const Batch& batch) {
+    return destinations_for(batch_total(batch));
+}
+
+/*
+* name: set_destination_formats
+* purpose: sets the destination rack formats batches may fill, and how many of each one batch may use
+* arguments: the formats, and a string that is set to a description of the problem if they can't be used
+* returns: true if the formats were set
+* notes: sorts the formats densest first and rebuilds destination_room, so every later batch is sized for them. a single format of
+*        RACK_CAPACITY spots with no limit below BATCH_CAPACITY is the same as no formats at all
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::set_destination_formats(const vector<Destination_Format>& formats, string& error) {
+    vector<Destination_Format> sorted = formats;
+    stable_sort(sorted.begin(), sorted.end(), [](const Destination_Format& a, const Destination_Format& b) { return a.capacity > b.capacity; });
+    for (int f = 0; f < sorted.size(); f++) {
+        if (sorted[f].capacity < 1 || sorted[f].limit < 1) {
+            error = "destination formats need at least 1 spot and a limit of at least 1 rack per batch";
+            return false;
+        }
+        if (f > 0 && sorted[f].capacity == sorted[f - 1].capacity) {
+            error = "destination format " + to_string(sorted[f].capacity) + " is listed twice";
+            return false;
+        }
+    }
+    if (sorted.size() > 8) {
+        error = "at most 8 destination formats can be mixed";
+        return false;
+    }
+    if (sorted.size() == 1 && sorted[0].capacity == RACK_CAPACITY && sorted[0].limit >= BATCH_CAPACITY) {
+        sorted.clear();
     }
-    //if less than 19 left, create the last batch with all remaining sources
-    distribute_remainder();
+
+    array<int, BATCH_CAPACITY + 1> room;
+    for (int d = 0; d <= BATCH_CAPACITY; d++) {
+        if (sorted.empty()) {
+            room[d] = d * RACK_CAPACITY;
+            continue;
+        }
+        //the densest racks first, each format up to its limit
+        room[d] = 0;
+        int left = d;
+        for (int f = 0; f < sorted.size() && left > 0; f++) {
+            int used = min(left, sorted[f].limit);
+            room[d] += used * sorted[f].capacity;
+            left -= used;
+        }
+    }
+    if (room[BATCH_CAPACITY - 1] < RACK_CAPACITY) {
+        error = "the destination formats can't hold a full " + to_string(RACK_CAPACITY) + " sample source rack in one batch";
+        return false;
+    }
+    destination_formats = sorted;
+    destination_room = room;
+    return true;
 }
 
+/*
+* name: destinations_for
+* purpose: finds the fewest destination racks that can hold a number of samples in one batch
+* arguments: the number of samples
+* returns: the number of destination racks, more than BATCH_CAPACITY if no batch can hold that many
+* notes: with the single format this is the sample total / RACK_CAPACITY rounded up
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::destinations_for(int total) {
+    if (destination_formats.empty()) {
+        return (total + RACK_CAPACITY - 1) / RACK_CAPACITY;
+    }
+    for (int d = 0; d <= BATCH_CAPACITY; d++) {
+        if (destination_room[d] >= total) {
+            return d;
+        }
+    }
+    return BATCH_CAPACITY + 1;
+}
+
+/*
+* name: destination_mix
+* purpose: chooses which destination racks hold a batch's samples
+* arguments: the number of samples in the batch
+* returns: how many racks of each format in destination_formats to use, or an empty vector if no batch can hold that many
+* notes: uses destinations_for racks in total, and of the mixes of that many racks that fit the samples, the one with the fewest
+*        empty spots, then the fewest dense racks. only a handful of formats are allowed, so every mix is tried
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+vector<int> Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::destination_mix(int total) {
+    int num_destinations = destinations_for(total);
+    if (num_destinations > BATCH_CAPACITY) {
+        return {};
+    }
+    int num_formats = destination_formats.size();
+    vector<int> best;
+    int best_room = 0;
+    vector<int> counts(num_formats, 0);
+    //fills counts[f..] with the left racks still to place, room being the spots of the racks placed so far
+    auto place = [&](auto& self, int f, int left, int room) -> void {
+        if (f == num_formats) {
+            //mixes are tried from the most dense racks to the fewest, so keeping the last of equal room keeps the fewest dense racks
+            if (left == 0 && room >= total && (best.empty() || room <= best_room)) {
+                best = counts;
+                best_room = room;
+            }
+            return;
+        }
+        for (int used = min(left, destination_formats[f].limit); used >= 0; used--) {
+            counts[f] = used;
+            self(self, f + 1, left - used, room + used * destination_formats[f].capacity);
+        }
+        counts[f] = 0;
+    };
+    place(place, 0, num_destinations, 0);
+    return best;
+}
+
+/*
+* name: mix_text
+* purpose: describes a destination mix from destination_mix for the csv and the overview
+* arguments: the number of racks of each format
+* returns: the formats used as count x spots joined by +, e.g. 2x384+1x96, or "none fits" for an empty mix
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+string Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::mix_text(const vector<int>& mix) {
+    if (mix.empty()) {
+        return "none fits";
+    }
+    string text;
+    for (int f = 0; f < mix.size(); f++) {
+        if (mix[f] > 0) {
+            text += (text.empty() ? "" : "+") + to_string(mix[f]) + "x" + to_string(destination_formats[f].capacity);
+        }
+    }
+    return text;
+}
+
+/*
+* name: get_total_destinations
+* purpose: adds up the destination racks used by every finished batch
+* arguments: none
+* returns: the total number of destination racks, fewer means fuller destinations for the same samples
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::get_total_destinations() {
+    int total = 0;
+    for (int i = 0; i < finished_batches.size(); i++) {
+        total += batch_destinations(finished_batches[i]);
+    }
+    return total;
+}
+
+/*
+* name: count_invalid_batches
+* purpose: counts the finished batches whose sources and destinations together exceed BATCH_CAPACITY
+* arguments: none
+* returns: the number of invalid batches
+* notes: fit_testing keeps the heuristic from overfilling a batch, so this is 0 unless a plan was read back or changed by hand
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::count_invalid_batches() {
+    int invalid = 0;
+    for (int i = 0; i < finished_batches.size(); i++) {
+        if (finished_batches[i].batch_sources.size() + batch_destinations(finished_batches[i]) > BATCH_CAPACITY) {
+            invalid++;
+        }
+    }
+    return invalid;
+}
+
+/*
+* name: check_frequencies
+* purpose: debug-only consistency check that sample_frequencies still matches a full rebuild from the remaining racks
+* arguments: none
+* returns: none
+* notes: only valid between batches, when nothing is reserved in the testing array. compiled out of release builds
+*/
+#ifndef NDEBUG
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::check_frequencies() {
+    for (int i = 1; i < source_buckets.size(); i++) {
+        if (sample_frequencies[i] != source_buckets[i].size() || available_mask.test(i) != (sample_frequencies[i] > 0)) {
+            cerr << "sample_frequencies[" << i << "] is " << sample_frequencies[i] << " but " << source_buckets[i].size()
+                 << " racks with that sample number remain, exiting now" << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+#endif
+
 /*
 * name: distribute_remainder
-* purpose: creates the remainder of the batches when there are less than 19 sources using a greedy approach
+* purpose: creates the remainder of the batches when there are BATCH_CAPACITY - 1 or fewer sources, using the fewest batches
+*          possible
 * arguments: none
 * returns: none
-* notes: only use when less than 19 sources are left to be distributed
-*/
-void Program::distribute_remainder() {
-    //continue making new batches until there are no more sources left
-    while (all_sources.size() > 0) {
-        //reset testing array
-        testing_array.clear();
-
-        int sum = 0;
-        int num_destinations = 0;
-        for (int i = 0; i < all_sources.size(); i++) {
-
-            sum += all_sources.at(i).num_samples;
-            //i is the number of sources currently, so check if the sum surpasses the number of spots in the destination racks
-            if (sum > (num_destinations * RACK_CAPACITY)) {
-                num_destinations++;
-            }
-            //number of racks exceeds BATCH_CAPACITY, so break and move onto next batch
-            if (testing_array.size() + 1 + num_destinations > BATCH_CAPACITY) {
-                break;
-            }
-            testing_array.push_back(all_sources.at(i).num_samples);
+* notes: only use when BATCH_CAPACITY - 1 or fewer sources are left to be distributed. pack_remainder (Exact_Batch.cpp) finds
+*        the partition, the racks in each batch are kept in read order
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::distribute_remainder() {
+    //walk the leftover racks in the order they were read in
+    vector<int> remaining = remaining_in_order();
+    if (remaining.empty()) {
+        return;
+    }
+
+    vector<int> group_of;
+    if (mixed_destinations()) {
+        vector<int> samples;
+        for (int i = 0; i < remaining.size(); i++) {
+            samples.push_back(rack_samples(remaining.at(i)));
+        }
+        group_of = pack_mixed_remainder(samples);
+    }
+    else {
+        vector<int> loads;
+        for (int i = 0; i < remaining.size(); i++) {
+            loads.push_back(rack_samples(remaining.at(i)) + RACK_CAPACITY);
         }
-        //finalize spots by adding source racks to a new Batch, removing the source racks from all_sources, and pushing that Batch back
-        finished_batches.push_back(finalize_spots());
+        group_of = pack_remainder(loads);
+    }
+
+    vector<Batch> new_batches(*max_element(group_of.begin(), group_of.end()) + 1);
+    for (int i = 0; i < remaining.size(); i++) {
+        //take the rack so sample_frequencies stays in step with what is left
+        decrement_frequency(rack_samples(remaining.at(i)));
+        new_batches[group_of[i]].batch_sources.push_back(remaining.at(i));
+    }
+    //every remaining rack has been taken
+    for (int i = 1; i < source_buckets.size(); i++) {
+        source_buckets[i].clear();
+    }
+    sources_remaining = 0;
+
+    for (int b = 0; b < new_batches.size(); b++) {
+        new_batches[b].batch_num = finished_batches.size() + 1;
+        finished_batches.push_back(new_batches[b]);
+    }
+}
+
+/*
+* name: remaining_in_order
+* purpose: collects the indices of all undistributed source racks, sorted into the order they were read in
+* arguments: none
+* returns: a vector of indices into racks
+* notes: sorts every remaining index, so only meant for the small leftover set handled by distribute_remainder
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+vector<int> Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::remaining_in_order() {
+    vector<int> remaining;
+    remaining.reserve(sources_remaining);
+    for (int i = 1; i < source_buckets.size(); i++) {
+        remaining.insert(remaining.end(), source_buckets[i].begin(), source_buckets[i].end());
     }
+    sort(remaining.begin(), remaining.end());
+    return remaining;
 }
 
 /*
@@ -120,49 +655,94 @@ void Program::distribute_remainder() {
 * purpose: chooses the number of sources to use for the current Batch based on sample_frequencies
 * arguments: none
 * returns: the number of sources to use
-* notes: see comments for more information on algorithm
+* notes: the trial batch is the largest rack plus the k smallest of the rest, for growing k, until its total no longer fits in
+*        the room left for k + 1 sources. totals only grow with k and the room only shrinks, so both that k and the last k that
+*        leaves spots free (the backup) are found by binary search over prefix counts and sums of the histogram, without adding
+*        any rack to the testing array
 */
-int Program::choose_num_sources() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::choose_num_sources() {
     //reset the testing array
-    testing_array.clear();
+    clear_testing();
 
-    //start with the smallest number of sources
-    int num_sources = 1;
-    int destination_spots = (BATCH_CAPACITY - num_sources) * RACK_CAPACITY;
-
-    //add the largest value
+    //start from the largest value
     int highest_valid = find_next_highest_valid(RACK_CAPACITY + 1);
     if (highest_valid == -1) {
         //if no valid values found, use backup or handle gracefully
         return 1;
     }
-    add_in_order(testing_array, highest_valid);
 
-    //find the most sources we can add to the highest value without the sample total exceeding the number of destination spots
-    while (total_testing_samples() <= destination_spots && num_sources < BATCH_CAPACITY) {
-        //add the remaining spots with the smallest value left
-        int smallest = find_smallest();
-        if (smallest == -1) {
-            break; //no more sources available
-        }
-        add_in_order(testing_array, smallest);
-        //update number of sources and destination spots
-        num_sources++;
-        destination_spots = (BATCH_CAPACITY - num_sources) * RACK_CAPACITY;
+    //count_upto[v] and sum_upto[v] are the number and samples of the other racks with at most v samples
+    array<int, RACK_CAPACITY + 1> count_upto;
+    array<int, RACK_CAPACITY + 1> sum_upto;
+    count_upto[0] = 0;
+    sum_upto[0] = 0;
+    for (int num = 1; num <= RACK_CAPACITY; num++) {
+        int others = sample_frequencies[num] - (num == highest_valid ? 1 : 0);
+        count_upto[num] = count_upto[num - 1] + others;
+        sum_upto[num] = sum_upto[num - 1] + others * num;
+    }
+    int num_others = count_upto[RACK_CAPACITY];
 
-        if (total_testing_samples() < destination_spots) {
-            backup_array = testing_array;
+    //total of the largest value and the k smallest other values
+    auto trial_total = [&](int k) {
+        if (k == 0) {
+            return highest_valid;
+        }
+        //the k-th smallest value is the first with at least k racks up to it
+        int num = lower_bound(count_upto.begin() + 1, count_upto.end(), k) - count_upto.begin();
+        return highest_valid + sum_upto[num - 1] + (k - count_upto[num - 1]) * num;
+    };
+    //whether another value could still be added to the trial batch of k + 1 sources
+    auto can_grow = [&](int k) {
+        return k + 1 < BATCH_CAPACITY && k < num_others && trial_total(k) <= destination_room[BATCH_CAPACITY - 1 - k];
+    };
+    //whether the trial batch of k + 1 sources leaves destination spots free
+    auto leaves_room = [&](int k) {
+        return trial_total(k) < destination_room[BATCH_CAPACITY - 1 - k];
+    };
+
+    //the trial stops at the first k that can't grow, which is never past the number of other racks or BATCH_CAPACITY - 1
+    int low = 0;
+    int high = min(BATCH_CAPACITY - 1, num_others);
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (can_grow(mid)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
         }
-
     }
-
-    //remove all values from testing array to reset for when the values are actually added
-    size_t num_to_remove = testing_array.size();
-    for (int i = 0; i < num_to_remove; i++) {
-        remove_from_testing(testing_array.at(0));
+    int last_k = low;
+
+    //the backup is the largest trial batch past the first that leaves spots free
+    low = 0;
+    high = last_k;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (leaves_room(mid)) {
+            low = mid;
+        }
+        else {
+            high = mid - 1;
+        }
     }
-    //at the point, the total has exceeding the destination spots, so decrease num sources and return
-    return num_sources - 1;
+    int backup_k = low;
+    //a room that stops growing can leave no valid configuration past the largest rack, so with mixed formats it alone is the backup
+    if (backup_k > 0 || mixed_destinations()) {
+        backup_array.clear();
+        backup_array.push_back(highest_valid);
+        for (int num = 1; backup_array.size() <= backup_k; num++) {
+            int others = sample_frequencies[num] - (num == highest_valid ? 1 : 0);
+            for (int i = 0; i < others && backup_array.size() <= backup_k; i++) {
+                backup_array.push_back(num);
+            }
+        }
+    }
+
+    //at this point, the total has exceeded the destination spots, so the sources before the last value are the answer
+    return last_k;
 }
 
 /*
@@ -172,14 +752,12 @@ int Program::choose_num_sources() {
 * returns: true if valid, false if not valid
 * notes: none
 */
-bool Program::is_valid(int num) {
-    if (num < 1 || num > 95) {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::is_valid(int num) {
+    if (num < 1 || num > RACK_CAPACITY - 1) {
         return false;
     }
-    if (sample_frequencies[num] > 0) {
-        return true;
-    }
-    return false;
+    return available_mask.test(num);
 }
 
 /*
@@ -187,27 +765,41 @@ bool Program::is_valid(int num) {
 * purpose: main function that finds the best combination for the next batch and creates it
 * arguments: the number of source racks to use for this batch
 * returns: none
-* notes: see comments for more details on algorithm
+* notes: see compose_new_batch
 */
-void Program::create_new_batch(int num_source_racks) {
-    populate_frequencies();
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::create_new_batch(int num_source_racks) {
+    compose_new_batch(num_source_racks);
+    //create the batch, add sources with corresponding sample numbers to it, and push the batch to the end of the finished_batches vector
+    finished_batches.push_back(finalize_spots());
+}
+
+/*
+* name: compose_new_batch
+* purpose: finds the best combination for the next batch and reserves it in the testing array, without taking any racks yet
+* arguments: the number of source racks to use for this batch
+* returns: none
+* notes: see comments for more details on algorithm. the combination can be taken with finalize_spots or released with
+*        rollback_testing(0)
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::compose_new_batch(int num_source_racks) {
     //reset testing array each time
-    testing_array.clear();
+    clear_testing();
+    RACK_COUNT(heuristic_batches, 1);
+
+    //a room that stops growing can leave space for only the largest rack, which has no separate last spot
+    if (num_source_racks < 2) {
+        add_in_order(find_next_highest_valid(RACK_CAPACITY + 1));
+        return;
+    }
 
     //add all values except one and find the ideal last spot
     bool success = add_all_except_last(num_source_racks);
     //if add_all_except_last failed, use backup array
     if (!success) {
-        //first, clear testing array and restore frequencies
-        while (testing_array.size() > 0) {
-            remove_from_testing(testing_array[0]);
-        }
-        //now, use backup array and update frequencies accordingly
-        testing_array = backup_array;
-        for (int i = 0; i < testing_array.size(); i++) {
-            sample_frequencies[testing_array[i]]--;
-        }
-        finished_batches.push_back(finalize_spots());
+        RACK_COUNT(backup_fallbacks[BACKUP_ADD_ALL_EXCEPT_LAST], 1);
+        restore_backup();
         return;
     }
 
@@ -222,32 +814,16 @@ void Program::create_new_batch(int num_source_racks) {
         bool decrease_success = decrease_testing_total(ideal_last_spot, to_add, num_source_racks);
         //use backup array if decrease fails
         if (!decrease_success) {
-            //first, clear testing array and restore frequencies
-            while (testing_array.size() > 0) {
-                remove_from_testing(testing_array[0]);
-            }
-            //now, use backup array and update frequencies accordingly
-            testing_array = backup_array;
-            for (int i = 0; i < testing_array.size(); i++) {
-                sample_frequencies[testing_array[i]]--;
-            }
-            finished_batches.push_back(finalize_spots());
+            RACK_COUNT(backup_fallbacks[BACKUP_DECREASE_FAILED], 1);
+            restore_backup();
             return;
         }
         while (not (is_valid(ideal_last_spot))) {
             int next_highest = find_next_highest_valid(ideal_last_spot);
             //use backup array if no valid values found
             if (next_highest == -1) {
-                //first, clear testing array and restore frequencies
-                while (testing_array.size() > 0) {
-                    remove_from_testing(testing_array[0]);
-                }
-                //now, use backup array and update frequencies accordingly
-                testing_array = backup_array;
-                for (int i = 0; i < testing_array.size(); i++) {
-                    sample_frequencies[testing_array[i]]--;
-                }
-                finished_batches.push_back(finalize_spots());
+                RACK_COUNT(backup_fallbacks[BACKUP_NO_VALID_LAST_SPOT], 1);
+                restore_backup();
                 return;
             }
             ideal_last_spot = next_highest;
@@ -258,11 +834,8 @@ void Program::create_new_batch(int num_source_racks) {
     }
     //add final value to testing array (note: if approximating, backup_array will already have num_sources sources, no last spot necessary)
     if (!approximate) {
-        add_in_order(testing_array, ideal_last_spot);
+        add_in_order(ideal_last_spot);
     }
-
-    //create the batch, add sources with corresponding sample numbers to it, and push the batch to the end of the finished_batches vector
-    finished_batches.push_back(finalize_spots());
 }
 
 
@@ -274,7 +847,8 @@ void Program::create_new_batch(int num_source_racks) {
 * notes: the largest value is never replaced because we have validated using choose_num_samples that its sum with the
 *        smallest remaining valid sample numbers will be less than or equal to the number of destination spots available
 */
-bool Program::decrease_testing_total(int& ideal_last_spot, int& to_add, int& num_source_racks) {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::decrease_testing_total(int& ideal_last_spot, int& to_add, int& num_source_racks) {
     //decrease only necessary if sum is higher than the number of available spots
     while (ideal_last_spot < 1) {
         if (testing_array.size() < 2) {
@@ -282,7 +856,7 @@ bool Program::decrease_testing_total(int& ideal_last_spot, int& to_add, int& num
         }
 
         //find the second largest value, which we will remove
-        int second_largest = testing_array.at(testing_array.size() - 2);
+        int second_largest = testing_array.second_largest();
         //decrement to find the next highest valid value, which we will add
         to_add = find_next_highest_valid(second_largest);
 
@@ -291,8 +865,9 @@ bool Program::decrease_testing_total(int& ideal_last_spot, int& to_add, int& num
         }
 
         //replace - note, these methods update the sample_frequencies array
+        RACK_COUNT(decrease_iterations, 1);
         remove_from_testing(second_largest);
-        add_in_order(testing_array, to_add);
+        add_in_order(to_add);
 
         //update ideal_last_spot for the next loop
         ideal_last_spot = ideal_last(num_source_racks);
@@ -305,17 +880,12 @@ bool Program::decrease_testing_total(int& ideal_last_spot, int& to_add, int& num
 * purpose: returns the next highest valid number based on sample_frequencies
 * arguments: an int (current) for the value to start decrementing at
 * returns: the next highest valid sample number, or -1 if none found
-* notes: none
+* notes: reads available_mask instead of scanning sample_frequencies
 */
-int Program::find_next_highest_valid(int current) {
-    for (int i = current - 1; i > 0; i--) {
-        if (sample_frequencies[i] > 0) {
-            return i;
-        }
-    }
-
-    //if made it to the end, then no valid values exist
-    return -1;
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::find_next_highest_valid(int current) {
+    //bit 0 is never set, so -1 comes back if no valid values exist
+    return available_mask.highest_below(current);
 }
 
 /*
@@ -325,9 +895,10 @@ int Program::find_next_highest_valid(int current) {
 * returns: an int that represents the largest value
 * notes: arguments may be updated through pointers
 */
-void Program::increase_testing_total(int& ideal_last_spot, int& to_add, int& num_source_racks, bool& approximate) {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::increase_testing_total(int& ideal_last_spot, int& to_add, int& num_source_racks, bool& approximate) {
     //start by removing the smallest value in the testing array
-    int to_remove = testing_array.at(0);
+    int to_remove = testing_array.smallest();
 
     //continue increase total process until the ideal last spot is available or until the we've reached the largest possible value
     while ((ideal_last_spot > 0 && !is_valid(ideal_last_spot))) {
@@ -341,29 +912,28 @@ void Program::increase_testing_total(int& ideal_last_spot, int& to_add, int& num
             return;
         }
 
+        //once the largest value can't be raised any further the swaps stop making progress, so use the backup instead
+        if (to_add == to_remove && to_remove == testing_array.largest()) {
+            RACK_COUNT(backup_fallbacks[BACKUP_INCREASE_OVERSHOT], 1);
+            restore_backup();
+            approximate = true;
+            return;
+        }
+
         //otherwise, finalize by removal and addition, updating sample_frequencies
+        RACK_COUNT(increase_iterations, 1);
         remove_from_testing(to_remove);
-        add_in_order(testing_array, to_add);
+        add_in_order(to_add);
         ideal_last_spot = ideal_last(num_source_racks);
         if (ideal_last_spot < 1) {
-            while (testing_array.size() > 0) {
-                remove_from_testing(testing_array[0]);
-            }
-            //use backup array and update frequencies accordingly
-            testing_array = backup_array;
-            for (int i = 0; i < testing_array.size(); i++) {
-                sample_frequencies[testing_array[i]]--;
-            }
+            RACK_COUNT(backup_fallbacks[BACKUP_INCREASE_OVERSHOT], 1);
+            restore_backup();
             approximate = true;
             return;
         }
 
         //update the next smallest value in the testing array
-        int i = 0;
-        while (i < testing_array.size() - 1 && testing_array.at(i) <= to_remove) {
-            i++;
-        }
-        to_remove = testing_array.at(i);
+        to_remove = testing_array.next_above(to_remove);
     }
 }
 
@@ -372,16 +942,44 @@ void Program::increase_testing_total(int& ideal_last_spot, int& to_add, int& num
 * purpose: returns the next smallest valid number based on sample_frequencies
 * arguments: an int (current) for the value to start incrementing at
 * returns: the next smallest valid number
+* notes: reads available_mask instead of scanning sample_frequencies
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::find_next_smallest_valid(int current) {
+    int next = available_mask.lowest_above(current);
+    if (next == -1) {
+        //otherwise, current is the largest already - can't get a next smallest
+        return current;
+    }
+    return next;
+}
+
+/*
+* name: increment_frequency
+* purpose: marks one more rack with the given sample number as available, setting its bit in available_mask if the bucket was empty
+* arguments: the sample number
+* returns: none
 * notes: none
 */
-int Program::find_next_smallest_valid(int current) {
-    for (int i = current + 1; i < RACK_CAPACITY + 1; i++) {
-        if (sample_frequencies[i] > 0) {
-            return i;
-        }
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::increment_frequency(int num) {
+    if (sample_frequencies[num]++ == 0) {
+        available_mask.set(num);
+    }
+}
+
+/*
+* name: decrement_frequency
+* purpose: marks one rack with the given sample number as no longer available, clearing its bit in available_mask if the bucket empties
+* arguments: the sample number
+* returns: none
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::decrement_frequency(int num) {
+    if (--sample_frequencies[num] == 0) {
+        available_mask.clear(num);
     }
-    //otherwise, current is the largest already - can't get a next smallest
-    return current;
 }
 
 /*
@@ -391,7 +989,8 @@ int Program::find_next_smallest_valid(int current) {
 * returns: none
 * notes: output will be a csv file containing the batch statistics
 */
-void Program::export_results() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::export_results() {
 
     cout << "A csv file containing the results will be exported, please enter the name you would like to save the file as:" << endl;
     string filename;
@@ -409,54 +1008,115 @@ void Program::export_results() {
         exit(EXIT_FAILURE);
     }
 
-    //create output string and add information
-    string output = "Rack ID,Sample Count,Batch ID Number,Number of Sources,Number of Destinations,Total Sample Count In Batch\n";
-
-    for (int i = 0; i < finished_batches.size(); i++) {
-        //calculate batch-level statistics
-        int num_sources = finished_batches.at(i).batch_sources.size();
-        int total_spots_filled = 0;
-        for (int k = 0; k < num_sources; k++) {
-            total_spots_filled += finished_batches.at(i).batch_sources.at(k).num_samples;
-        }
-        int num_destinations = total_spots_filled / RACK_CAPACITY;
-        if (total_spots_filled % RACK_CAPACITY != 0) {
-            num_destinations++;
-        }
-
-        for (int j = 0; j < finished_batches.at(i).batch_sources.size(); j++) {
-            //add id to output
-            output += finished_batches.at(i).batch_sources.at(j).id;
-            output += ",";
+    write_results(outfile);
+    cout << endl << "Your text file has been created with the name: " << filename << endl;
+    cout << "Output file should be located in folder named 'results', located within the same folder as RackFinal.vcxproj" << endl;
 
-            //add number of samples in rack to output
-            output += to_string(finished_batches.at(i).batch_sources.at(j).num_samples);
-            output += ",";
+    outfile.close();
 
-            //add back number to output
-            output += to_string(i + 1);
-            output += ",";
+    //the lower bound goes in a file of its own, so the results csv keeps one row per source rack
+    string bound_filename = filename.substr(0, filename.size() - 4) + "_bound.csv";
+    ofstream boundfile("results/" + bound_filename);
+    write_bound(boundfile);
+    cout << "The lower bound on the number of batches is in " << bound_filename << ", in the same folder" << endl;
+}
 
-            //add number of source racks to output
-            output += to_string(num_sources);
-            output += ",";
+/*
+* name: write_results
+* purpose: writes the results csv (one row per source rack) to a stream
+* arguments: the stream to write to
+* returns: none
+* notes: same contents export_results saves in results/
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_results(ostream& out) {
+    write_results_header(out);
+    write_result_rows(out, 0);
+    //the csv has always ended with one more blank line
+    out << endl;
+}
 
-            //add number of destination racks to output
-            output += to_string(num_destinations);
-            output += ",";
+/*
+* name: write_results_header
+* purpose: writes the column names of the results csv
+* arguments: the stream to write to
+* returns: none
+* notes: see write_results
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_results_header(ostream& out) {
+    RACK_TIME_PHASE(write);
+    Buffered_Writer writer(out);
+    writer.text("Rack ID,Sample Count,Batch ID Number,Number of Sources,Number of Destinations,Total Sample Count In Batch");
+    //with mixed destination formats, which racks each batch fills, as count x spots for each format
+    writer.text(mixed_destinations() ? ",Destination Racks\n" : "\n");
+    writer.flush();
+    out.flush();
+}
 
-            //add number of total spots filled in the destination racks to output
-            output += to_string(total_spots_filled);
-            output += "\n";
+/*
+* name: write_result_rows
+* purpose: writes the results csv rows of the finished batches from first_batch on, one row per source rack
+* arguments: the stream to write to and the index in get_batches of the first batch to write
+* returns: none
+* notes: see write_results
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_result_rows(ostream& out, int first_batch) {
+    RACK_TIME_PHASE(write);
+    //rows are formatted into a fixed buffer as the batches are walked, never into one string for the whole plan
+    Buffered_Writer writer(out);
+    for (int i = first_batch; i < finished_batches.size(); i++) {
+        //calculate batch-level statistics
+        const vector<int>& sources = finished_batches[i].batch_sources;
+        int num_sources = sources.size();
+        int total_spots_filled = batch_total(finished_batches[i]);
+        int num_destinations = batch_destinations(finished_batches[i]);
+        string mix = mixed_destinations() ? mix_text(destination_mix(total_spots_filled)) : "";
+
+        for (int j = 0; j < num_sources; j++) {
+            //rack id, number of samples in the rack, batch number, number of source racks, number of destination racks, and
+            //number of total spots filled in the destination racks
+            writer.text(racks.id(sources[j]));
+            writer.put(',');
+            writer.number(racks.samples(sources[j]));
+            writer.put(',');
+            writer.number(i + 1);
+            writer.put(',');
+            writer.number(num_sources);
+            writer.put(',');
+            writer.number(num_destinations);
+            writer.put(',');
+            writer.number(total_spots_filled);
+            if (mixed_destinations()) {
+                writer.put(',');
+                writer.text(mix);
+            }
+            writer.put('\n');
         }
-        output += "\n";
+        writer.put('\n');
     }
 
-    outfile << output << endl;
-    cout << endl << "Your text file has been created with the name: " << filename << endl;
-    cout << "Output file should be located in folder named 'results', located within the same folder as RackFinal.vcxproj" << endl;
+    writer.flush();
+    out.flush();
+}
 
-    outfile.close();
+/*
+* name: write_bound
+* purpose: writes a csv comparing the number of batches to the lower bound, kept next to the results csv
+* arguments: the stream to write to
+* returns: none
+* notes: one header row and one row of values, so the results csv itself never holds anything but rack rows
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_bound(ostream& out) {
+    Buffered_Writer writer(out);
+    //how the plan compares to the best possible
+    writer.text("Number of Batches,Batch Lower Bound,Batches Above Lower Bound,Optimality Gap (%)\n");
+    writer.text(to_string(finished_batches.size()) + "," + to_string(batch_lower_bound) + ",");
+    writer.text(to_string((int)finished_batches.size() - batch_lower_bound) + "," + to_string(optimality_gap()) + "\n");
+    writer.flush();
+    out.flush();
 }
 
 /*
@@ -466,7 +1126,8 @@ void Program::export_results() {
 * returns: none
 * notes: summary is outputted
 */
-void Program::print_summary() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::print_summary() {
     string overview;
     cout << "The program has created a solution, would you like to see to see an overview before exporting as a csv file? (y/n)" << endl;
     cin >> overview;
@@ -477,27 +1138,71 @@ void Program::print_summary() {
     }
 
     if (overview == "y" || overview == "yes") {
-        cout << "Number of batches is: " << finished_batches.size() << endl;
-        for (int i = 0; i < finished_batches.size(); i++) {
-            cout << "-- Batch number " << i + 1 << " --" << endl;
-            cout << "Number of sources in this batch: " << finished_batches.at(i).batch_sources.size() << endl;
-
-            int total_spots_filled = 0;
-            for (int k = 0; k < finished_batches.at(i).batch_sources.size(); k++) {
-                total_spots_filled += finished_batches.at(i).batch_sources.at(k).num_samples;
-            }
+        write_summary(cout);
+    }
+}
 
-            int num_destinations = total_spots_filled / RACK_CAPACITY;
-            if (total_spots_filled % RACK_CAPACITY != 0) {
-                num_destinations++;
-            }
-            cout << "Number of destinations in this batch: " << num_destinations << endl;
-            cout << "Number of spots filled in destination racks: " << total_spots_filled << endl;
+/*
+* name: write_summary
+* purpose: writes the overview print_summary shows to a stream
+* arguments: the stream to write to
+* returns: none
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_summary(ostream& out) {
+    out << "Number of batches is: " << finished_batches.size() << endl;
+    out << "Lower bound on the number of batches is: " << batch_lower_bound << " (" << (int)finished_batches.size() - batch_lower_bound
+        << " batches above, gap of " << optimality_gap() << "%)" << endl;
+    for (int i = 0; i < finished_batches.size(); i++) {
+        out << "-- Batch number " << i + 1 << " --" << endl;
+        out << "Number of sources in this batch: " << finished_batches.at(i).batch_sources.size() << endl;
+
+        int total_spots_filled = 0;
+        for (int k = 0; k < finished_batches.at(i).batch_sources.size(); k++) {
+            total_spots_filled += racks.samples(finished_batches.at(i).batch_sources.at(k));
         }
-        cout << endl;
+
+        int num_destinations = destinations_for(total_spots_filled);
+        out << "Number of destinations in this batch: " << num_destinations << endl;
+        if (mixed_destinations()) {
+            out << "Destination racks: " << mix_text(destination_mix(total_spots_filled)) << endl;
+        }
+        out << "Number of spots filled in destination racks: " << total_spots_filled << endl;
+    }
+    if (!held_racks.empty()) {
+        out << "Racks held for the next run: " << held_racks.size() << endl;
     }
+    if (num_deltas > 0) {
+        out << "Batches changed by the last delta: " << num_changed << endl;
+    }
+    out << endl;
 }
 
+#ifdef RACK_INSTRUMENTATION
+/*
+* name: write_stats
+* purpose: writes the phase times and hot path counters recorded so far as one JSON object on one line
+* arguments: the stream to write to
+* returns: none
+* notes: only built with RACK_INSTRUMENTATION
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::write_stats(ostream& out) {
+    const Phase_Times& times = stats.times;
+    out << "{\"load_s\":" << times.load << ",\"populate_s\":" << times.populate << ",\"choose_num_sources_s\":" << times.choose
+        << ",\"create_new_batch_s\":" << times.create << ",\"distribute_remainder_s\":" << times.remainder
+        << ",\"improve_s\":" << times.improve << ",\"export_s\":" << times.write
+        << ",\"heuristic_batches\":" << stats.heuristic_batches << ",\"backup_fallbacks\":{\"add_all_except_last\":"
+        << stats.backup_fallbacks[BACKUP_ADD_ALL_EXCEPT_LAST] << ",\"decrease_failed\":" << stats.backup_fallbacks[BACKUP_DECREASE_FAILED]
+        << ",\"no_valid_last_spot\":" << stats.backup_fallbacks[BACKUP_NO_VALID_LAST_SPOT]
+        << ",\"increase_overshot\":" << stats.backup_fallbacks[BACKUP_INCREASE_OVERSHOT] << "}"
+        << ",\"decrease_iterations\":" << stats.decrease_iterations << ",\"increase_iterations\":" << stats.increase_iterations
+        << ",\"find_source_calls\":" << stats.find_source_calls << ",\"testing_adds\":" << stats.testing_adds
+        << ",\"testing_removes\":" << stats.testing_removes << ",\"rollback_steps\":" << stats.rollback_steps << "}" << endl;
+}
+#endif
+
 
 /*
 * name: print_frequencies
@@ -507,7 +1212,8 @@ void Program::print_summary() {
 * returns: none
 * notes: only used for testing purposes
 */
-void Program::print_frequencies() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::print_frequencies() {
     cout << endl;
     for (int i = 1; i < sample_frequencies.size(); i++) {
         cout << i << ": " << sample_frequencies[i] << endl;
@@ -516,14 +1222,32 @@ void Program::print_frequencies() {
 
 /*
 * name: print_sources
-* purpose: prints the id and sample number of each source remaining in the all_sources vector
+* purpose: prints the id and sample number of each source that has not been distributed yet, in read order
 * arguments: none
 * returns: none
 * notes: only used for testing purposes
 */
-void Program::print_sources() {
-    for (int i = 0; i < all_sources.size(); i++) {
-        cout << all_sources.at(i).id << " " << all_sources.at(i).num_samples << endl;
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::print_sources() {
+    vector<int> remaining = remaining_in_order();
+    for (int i = 0; i < remaining.size(); i++) {
+        cout << racks.id(remaining.at(i)) << " " << racks.samples(remaining.at(i)) << endl;
+    }
+}
+
+/*
+* name: fit_testing
+* purpose: hands back the largest racks in the testing array until the rest fit in one batch
+* arguments: none
+* returns: none
+* notes: the heuristic's last spot and its backup_array fallback can overshoot the room, with one format (results_10.csv used to
+*        have 3 such batches) as well as with mixed formats, where the room isn't linear in the number of sources. fewer sources
+*        only ever leaves more room. a no-op for a batch that already fits
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::fit_testing() {
+    while (testing_array.size() > 1 && testing_array.sum() > destination_room[BATCH_CAPACITY - testing_array.size()]) {
+        remove_from_testing(testing_array.largest());
     }
 }
 
@@ -532,41 +1256,44 @@ void Program::print_sources() {
 * purpose: creates a new Batch and adds sources to the Batch based on the values in the testing array
 * arguments: none
 * returns: the Batch that was created
-* notes: none
+* notes: calls fit_testing first
 */
-Program::Batch Program::finalize_spots() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+typename Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::Batch Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::finalize_spots() {
+    fit_testing();
     Batch curr_batch;
     curr_batch.batch_num = finished_batches.size() + 1;
-    for (int i = 0; i < testing_array.size(); i++) {
-        Source_Rack curr_source = find_source(testing_array.at(i));
-        curr_batch.batch_sources.push_back(curr_source);
+    //add sources in non-decreasing order of sample number
+    for (int num = testing_array.smallest(); num != -1; num = testing_array.present.lowest_above(num)) {
+        for (int i = 0; i < testing_array.counts[num]; i++) {
+            curr_batch.batch_sources.push_back(find_source(num));
+        }
     }
     return curr_batch;
 }
 
 /*
 * name: find_source
-* purpose: finds and returns a Source_Rack in the all_sources array that has the sample number given, then removes it from the array
-* arguments: an int sample number to find a Source_Rack for
-* returns: none
-* notes: none
+* purpose: returns the earliest-read undistributed source rack that has the sample number given, and removes it from its bucket
+* arguments: an int sample number to find a source rack for
+* returns: the index in racks of the source rack that was taken
+* notes: O(1), the bucket for each sample number is a queue kept in read order
 */
-Program::Source_Rack Program::find_source(int sample_num) {
-    for (int i = 0; i < all_sources.size(); i++) {
-        if (all_sources.at(i).num_samples == sample_num) {
-            //create new source rack with the same data members to return
-            Source_Rack my_source;
-            my_source.id = all_sources.at(i).id;
-            my_source.num_samples = sample_num;
-
-            //remove source rack from vector
-            all_sources.erase(all_sources.begin() + i);
-            return my_source;
-        }
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::find_source(int sample_num) {
+    if (sample_num < 1 || sample_num > RACK_CAPACITY || source_buckets[sample_num].empty()) {
+        //if not found, something went wrong
+        cerr << "source " << sample_num << " not found when finalizing spots, exiting now";
+        exit(EXIT_FAILURE);
     }
-    //if not found, something went wrong
-    cerr << "source " << sample_num << " not found when finalizing spots, exiting now";
-    exit(EXIT_FAILURE);
+    deque<int>& bucket = source_buckets[sample_num];
+    int my_source = bucket.front();
+    RACK_COUNT(find_source_calls, 1);
+
+    //remove source rack from the remaining pool
+    bucket.pop_front();
+    sources_remaining--;
+    return my_source;
 }
 
 /*
@@ -576,14 +1303,15 @@ Program::Source_Rack Program::find_source(int sample_num) {
 * returns: bool indicating success (true) or failure (false)
 * notes: none
 */
-bool Program::add_all_except_last(int num_source_racks) {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::add_all_except_last(int num_source_racks) {
     //add largest value
     int largest = RACK_CAPACITY + 1;
     int highest_valid = find_next_highest_valid(largest);
     if (highest_valid == -1) {
         return false; //no valid values found
     }
-    add_in_order(testing_array, highest_valid);
+    add_in_order(highest_valid);
 
     //add frequencies based on ratios
     add_ratios(num_source_racks);
@@ -596,7 +1324,7 @@ bool Program::add_all_except_last(int num_source_racks) {
             return false;
         }
         else {
-            add_in_order(testing_array, smallest);
+            add_in_order(smallest);
         }
     }
     return true;
@@ -609,8 +1337,9 @@ bool Program::add_all_except_last(int num_source_racks) {
 * returns: an int representing the ideal last number
 * notes: none
 */
-int Program::ideal_last(int num_source_racks) {
-    int goal_sample_num = (BATCH_CAPACITY - num_source_racks) * RACK_CAPACITY;
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::ideal_last(int num_source_racks) {
+    int goal_sample_num = destination_room[BATCH_CAPACITY - num_source_racks];
     return goal_sample_num - total_testing_samples();
 }
 
@@ -619,14 +1348,11 @@ int Program::ideal_last(int num_source_racks) {
 * purpose: calculates the total sum of all the sample numbers in the testing array
 * arguments: none
 * returns: an int representing the total sum
-* notes: none
+* notes: O(1), the testing array keeps a running sum
 */
-int Program::total_testing_samples() {
-    int total = 0;
-    for (int i = 0; i < testing_array.size(); i++) {
-        total += testing_array.at(i);
-    }
-    return total;
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::total_testing_samples() {
+    return testing_array.sum();
 }
 
 /*
@@ -634,16 +1360,12 @@ int Program::total_testing_samples() {
 * purpose: finds the smallest available sample number
 * arguments: none
 * returns: an int representing the smallest available sample number
-* notes: none
+* notes: reads available_mask instead of scanning sample_frequencies
 */
-int Program::find_smallest() {
-    for (int i = 1; i <= RACK_CAPACITY; i++) {
-        if (sample_frequencies[i] != 0) {
-            return i;
-        }
-    }
-    //if no source racks left, return -1
-    return -1;
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::find_smallest() {
+    //if no source racks left, lowest_above returns -1
+    return available_mask.lowest_above(0);
 }
 
 /*
@@ -653,23 +1375,37 @@ int Program::find_smallest() {
 * returns: none
 * notes: this may cause an bug if there are large sample numbers with an unexpectedly high frequency
 */
-void Program::add_ratios(int num_source_racks) {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::add_ratios(int num_source_racks) {
+    //randomized passes start the walk at a random sample number and wrap around
+    int start = 1;
+    if (randomized) {
+        start = uniform_int_distribution<int>(1, RACK_CAPACITY)(rng);
+    }
     //calculate how many 1's, 2's, etc to used based on frequencies
-    for (int i = 1; i <= RACK_CAPACITY; i++) {
+    for (int step = 0; step < RACK_CAPACITY; step++) {
+        int i = (start - 1 + step) % RACK_CAPACITY + 1;
         //if there are no source_racks with that number of samples left, move on
         if (sample_frequencies[i] == 0) {
             continue;
         }
         else {
             //find amount to add based on ratio, truncate to an integer
-            int amount_to_add = (sample_frequencies[i] * num_source_racks) / all_sources.size();
+            int amount_to_add = (sample_frequencies[i] * num_source_racks) / sources_remaining;
+            //randomized passes round up instead with probability equal to the truncated fraction
+            if (randomized) {
+                int fraction = (sample_frequencies[i] * num_source_racks) % sources_remaining;
+                if (uniform_int_distribution<int>(0, sources_remaining - 1)(rng) < fraction) {
+                    amount_to_add++;
+                }
+            }
             //add that amount of the sample number to the vector as long as there are enough
             while (amount_to_add > 0 && sample_frequencies[i] > 0) {
                 //make sure there's a last spot available
                 if (testing_array.size() == num_source_racks - 1) {
                     return;
                 }
-                add_in_order(testing_array, i);
+                add_in_order(i);
                 amount_to_add--;
             }
         }
@@ -683,44 +1419,33 @@ void Program::add_ratios(int num_source_racks) {
 * returns: none
 * notes: only used for testing purposes
 */
-void Program::print_testing_array() {
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::print_testing_array() {
     if (testing_array.size() == 0) {
         cerr << "testing array is empty" << endl;
         return;
     }
     cout << "testing array: ";
-    for (int i = 0; i < testing_array.size(); i++) {
-        cout << testing_array.at(i) << " ";
+    vector<int> values = testing_array.sorted();
+    for (int i = 0; i < values.size(); i++) {
+        cout << values.at(i) << " ";
     }
     cout << endl;
 }
 
 /*
 * name: add_in_order
-* purpose: adds sample numbers to a vector in non-decreasing order
-* arguments: the vector to add the sample number to, the sample number to add
+* purpose: adds a sample number to the testing array, which keeps its values ordered by sample number
+* arguments: the sample number to add
 * returns: none
-* notes: used with both the testing array and the valid sample numbers array. if adding to the testing array, decreases the corresponding frequency in the sample_frequencies
-*        array to update availability
+* notes: decreases the corresponding frequency in the sample_frequencies array to update availability. O(1), nothing is shifted
 */
-void Program::add_in_order(vector<int>& which_vector, int to_add) {
-    //if array is empty or to_add is the largest value, add to back
-    if (which_vector.size() == 0 || to_add >= which_vector.at(which_vector.size() - 1)) {
-        which_vector.push_back(to_add);
-    }
-    else {
-        //otherwise, add to the first spot that would be in order
-        for (int i = 0; i < which_vector.size(); i++) {
-            if (to_add < which_vector.at(i)) {
-                which_vector.insert(which_vector.begin() + i, to_add);
-                break;
-            }
-        }
-    }
-    //update frequency if adding to testing array
-    if (which_vector == testing_array) {
-        sample_frequencies[to_add]--;
-    }
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::add_in_order(int to_add) {
+    testing_array.add(to_add);
+    decrement_frequency(to_add);
+    testing_log.push_back({ to_add, true });
+    RACK_COUNT(testing_adds, 1);
 }
 
 /*
@@ -729,20 +1454,72 @@ void Program::add_in_order(vector<int>& which_vector, int to_add) {
 *          to update availability
 * arguments: the sample number to remove
 * returns: none
-* notes: none
+* notes: O(1)
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::remove_from_testing(int to_remove) {
+    if (!testing_array.contains(to_remove)) {
+        cerr << to_remove << " is not in testing array" << endl;
+        return;
+    }
+    testing_array.remove(to_remove);
+    increment_frequency(to_remove);
+    testing_log.push_back({ to_remove, false });
+    RACK_COUNT(testing_removes, 1);
+}
+
+/*
+* name: clear_testing
+* purpose: empties the testing array and its undo log without touching sample_frequencies
+* arguments: none
+* returns: none
+* notes: only for when the racks in the testing array have been taken by finalize_spots (or nothing is reserved), otherwise
+*        the reserved racks would be lost from sample_frequencies
 */
-void Program::remove_from_testing(int to_remove) {
-    //find index of element to erase
-    int index = -1;
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::clear_testing() {
+    testing_array.clear();
+    testing_log.clear();
+}
 
-    for (int i = 0; i < testing_array.size(); i++) {
-        if (testing_array.at(i) == to_remove) {
-            index = i;
+/*
+* name: rollback_testing
+* purpose: undoes every change made to the testing array past a point in the undo log, restoring sample_frequencies with it
+* arguments: the length of the undo log to return to, 0 for everything since the testing array was last cleared
+* returns: none
+* notes: costs one step per change being undone, not per value in the testing array
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::rollback_testing(size_t checkpoint) {
+    RACK_COUNT(rollback_steps, testing_log.size() - checkpoint);
+    while (testing_log.size() > checkpoint) {
+        Testing_Change change = testing_log.back();
+        testing_log.pop_back();
+        if (change.added) {
+            testing_array.remove(change.sample_num);
+            increment_frequency(change.sample_num);
+        }
+        else {
+            testing_array.add(change.sample_num);
+            decrement_frequency(change.sample_num);
         }
     }
-    if (index == -1) {
-        cerr << to_remove << " is not in testing array" << endl;
+}
+
+/*
+* name: restore_backup
+* purpose: abandons the configuration built for the current batch and replaces it with backup_array
+* arguments: none
+* returns: none
+* notes: the testing array must have been cleared at the start of the batch, so rolling back to the empty log releases everything
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::restore_backup() {
+    rollback_testing(0);
+    for (int i = 0; i < backup_array.size(); i++) {
+        add_in_order(backup_array[i]);
     }
-    testing_array.erase(testing_array.begin() + index);
-    sample_frequencies[to_remove]++;
-}
\ No newline at end of file
+}
+
+#define INSTANTIATE_PROGRAM(RACK_CAPACITY, BATCH_CAPACITY) template class Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>;
+RACK_FORMATS(INSTANTIATE_PROGRAM)
@@ -1,11 +1,14 @@
 /*
 Program.h: interface for the Program class.
 
-The Program class contains the Batch and Source_Rack struct definitions, a vector that
-holds all the Source_Rack objects in the program, and a vector containing all the
-completed Batch objects. The methods of the Program class execute all of the functioning
-that combines Source_Racks into a Batch, utilizing additional data members like the
-sample_frequencies hash map and a testing vector to guide Batch creation.
+The Program class contains the Batch struct definition, a Rack_Store that holds every
+source rack in the program, and a vector containing all the completed Batch objects. The
+methods of the Program class execute all of the functioning that combines source racks
+into a Batch, utilizing additional data members like the sample_frequencies hash map and
+a testing vector to guide Batch creation.
+
+The class is Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>, built for each plate format in RACK_FORMATS, and Program is the
+96-spot format. Rack_Planner.h picks a format at run time.
 
 */
 
@@ -14,85 +17,685 @@ sample_frequencies hash map and a testing vector to guide Batch creation.
 
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <unordered_map>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <type_traits>
 
 using namespace std;
-//number of spots in a rack, usually 96
-const int RACK_CAPACITY = 96;
+//the planner is a template on the number of spots in a rack (RACK_CAPACITY) and the number of total racks in a batch
+//(BATCH_CAPACITY), so every loop over sample numbers has a compile-time bound. Program is the usual 96-spot, 20-rack format
+const int DEFAULT_RACK_CAPACITY = 96;
+const int DEFAULT_BATCH_CAPACITY = 20;
+
+//every (RACK_CAPACITY, BATCH_CAPACITY) format the planner is built for: 48, 96 and 384 spot plates in 20-rack batches. FORMAT is
+//expanded once per format, for the explicit instantiations at the end of each source file and for visit_format in Rack_Planner.h
+#define RACK_FORMATS(FORMAT) FORMAT(48, 20) FORMAT(96, 20) FORMAT(384, 20)
+
+//bitset with one bit per sample number (bit 0 is unused), used to find the nearest non-empty sample_frequencies bucket with a single
+//count-leading-zeros or count-trailing-zeros instead of walking the buckets one at a time
+template <int RACK_CAPACITY>
+struct Sample_Mask {
+	static const int NUM_WORDS = (RACK_CAPACITY + 64) / 64;
+	array<uint64_t, NUM_WORDS> words{};
+
+	void set(int num) { words[num >> 6] |= uint64_t(1) << (num & 63); }
+	void clear(int num) { words[num >> 6] &= ~(uint64_t(1) << (num & 63)); }
+	bool test(int num) const { return (words[num >> 6] >> (num & 63)) & 1; }
+
+	//highest set bit strictly below current, or -1 if none
+	int highest_below(int current) const {
+		int bit = min(current - 1, NUM_WORDS * 64 - 1);
+		if (bit < 0) {
+			return -1;
+		}
+		int w = bit >> 6;
+		uint64_t word = words[w] & (~uint64_t(0) >> (63 - (bit & 63)));
+		while (word == 0) {
+			if (--w < 0) {
+				return -1;
+			}
+			word = words[w];
+		}
+		return w * 64 + 63 - countl_zero(word);
+	}
+
+	//lowest set bit strictly above current, or -1 if none
+	int lowest_above(int current) const {
+		int bit = max(current + 1, 0);
+		if (bit >= NUM_WORDS * 64) {
+			return -1;
+		}
+		int w = bit >> 6;
+		uint64_t word = words[w] & (~uint64_t(0) << (bit & 63));
+		while (word == 0) {
+			if (++w >= NUM_WORDS) {
+				return -1;
+			}
+			word = words[w];
+		}
+		return w * 64 + countr_zero(word);
+	}
+};
+
+//ORs the bitset src, shifted up by shift bits, into dst, dropping bits shifted past the end. used by the subset-sum solvers,
+//which keep one bit per reachable sample total. src and dst may be the same bitset
+inline void shift_or(uint64_t* dst, const uint64_t* src, int shift, int num_words) {
+	int word_shift = shift / 64;
+	int bit_shift = shift % 64;
+	for (int w = num_words - 1; w >= word_shift; w--) {
+		uint64_t value = src[w - word_shift] << bit_shift;
+		if (bit_shift != 0 && w - word_shift - 1 >= 0) {
+			value |= src[w - word_shift - 1] >> (64 - bit_shift);
+		}
+		dst[w] |= value;
+	}
+}
+
+//multiset of sample numbers being tried for the next batch, stored as a tally per sample number with a cached size and sum.
+//adding, removing, summing and finding the smallest/largest/second largest entry never walk the whole batch
+template <int RACK_CAPACITY>
+struct Testing_Batch {
+	array<int, RACK_CAPACITY + 1> counts{};
+	//bit i is set exactly when counts[i] > 0
+	Sample_Mask<RACK_CAPACITY> present;
+	int num_racks = 0;
+	int total = 0;
+
+	int size() const { return num_racks; }
+	int sum() const { return total; }
+	bool contains(int num) const { return num >= 1 && num <= RACK_CAPACITY && counts[num] > 0; }
+
+	void add(int num) {
+		if (counts[num]++ == 0) {
+			present.set(num);
+		}
+		num_racks++;
+		total += num;
+	}
+
+	void remove(int num) {
+		if (--counts[num] == 0) {
+			present.clear(num);
+		}
+		num_racks--;
+		total -= num;
+	}
+
+	void clear() {
+		for (int num = smallest(); num != -1; num = present.lowest_above(num)) {
+			counts[num] = 0;
+		}
+		present = Sample_Mask<RACK_CAPACITY>();
+		num_racks = 0;
+		total = 0;
+	}
+
+	//-1 if the batch is empty
+	int smallest() const { return present.lowest_above(0); }
+	int largest() const { return present.highest_below(RACK_CAPACITY + 1); }
+
+	//the value that would sit second from the end if the batch were sorted, -1 if there are fewer than two entries
+	int second_largest() const {
+		int high = largest();
+		if (high == -1 || counts[high] > 1) {
+			return high;
+		}
+		return present.highest_below(high);
+	}
+
+	//the smallest entry greater than num, or the largest entry if there is none
+	int next_above(int num) const {
+		int next = present.lowest_above(num);
+		return next == -1 ? largest() : next;
+	}
+
+	//entries expanded in non-decreasing order
+	vector<int> sorted() const {
+		vector<int> values;
+		values.reserve(num_racks);
+		for (int num = smallest(); num != -1; num = present.lowest_above(num)) {
+			values.insert(values.end(), counts[num], num);
+		}
+		return values;
+	}
+};
+
+//every source rack read in, in read order, stored as a structure of arrays: all ids back to back in one arena addressed by 32-bit
+//offsets, and one byte per sample number (two when a rack holds more than 255). racks are referred to everywhere else by their
+//index in here
+template <int RACK_CAPACITY>
+struct Rack_Store {
+	using Count = conditional_t<RACK_CAPACITY <= UINT8_MAX, uint8_t, uint16_t>;
+
+	string id_arena;
+	//rack i's id is id_arena[id_offsets[i], id_offsets[i + 1])
+	vector<uint32_t> id_offsets = { 0 };
+	vector<Count> counts;
+
+	int size() const { return counts.size(); }
+	bool empty() const { return counts.empty(); }
+	string_view id(int rack) const { return string_view(id_arena).substr(id_offsets[rack], id_offsets[rack + 1] - id_offsets[rack]); }
+	int samples(int rack) const { return counts[rack]; }
+
+	//adds a rack, returns false if the arena would outgrow 32-bit offsets
+	bool add(string_view id, int num_samples) {
+		if (id_arena.size() + id.size() > UINT32_MAX) {
+			return false;
+		}
+		id_arena.append(id);
+		id_offsets.push_back(id_arena.size());
+		counts.push_back(num_samples);
+		return true;
+	}
+
+	//drops the racks from num_racks on, which are the newest
+	void truncate(int num_racks) {
+		id_arena.resize(id_offsets[num_racks]);
+		id_offsets.resize(num_racks + 1);
+		counts.resize(num_racks);
+	}
+
+	void reserve(size_t num_racks, size_t arena_size) {
+		id_arena.reserve(arena_size);
+		id_offsets.reserve(num_racks + 1);
+		counts.reserve(num_racks);
+	}
+};
+
+//hash table of rack indices keyed by the rack ids in a Rack_Store, with open addressing, so finding a rack by id stores no copy of
+//the id. racks are only ever added, like in the Rack_Store, except that end_trial erases the ones a trial added and compact_racks
+//rebuilds both without the racks deltas removed; a rack that is gone is skipped by the is_live test passed to find
+template <int RACK_CAPACITY>
+struct Rack_Index {
+	//rack index in each slot, -1 for an empty one. the number of slots is a power of two, kept at least twice the racks added
+	vector<int> slots;
+	int num_racks = 0;
+
+	//the first rack with this id that is_live(rack) accepts, or -1 if there is none
+	template <class Is_Live>
+	int find(const Rack_Store<RACK_CAPACITY>& racks, string_view id, Is_Live&& is_live) const {
+		if (slots.empty()) {
+			return -1;
+		}
+		size_t mask = slots.size() - 1;
+		for (size_t s = hash<string_view>()(id) & mask; slots[s] != -1; s = (s + 1) & mask) {
+			if (racks.id(slots[s]) == id && is_live(slots[s])) {
+				return slots[s];
+			}
+		}
+		return -1;
+	}
 
-//number of total racks in a batch, usually 20
-const int BATCH_CAPACITY = 20;
+	//adds a rack that is already in racks, doubling the slots first if they would be more than half full
+	void insert(const Rack_Store<RACK_CAPACITY>& racks, int rack) {
+		if (2 * (num_racks + 1) > slots.size()) {
+			vector<int> old = move(slots);
+			slots.assign(max<size_t>(64, 2 * old.size()), -1);
+			for (int i = 0; i < old.size(); i++) {
+				if (old[i] != -1) {
+					place(racks, old[i]);
+				}
+			}
+		}
+		place(racks, rack);
+		num_racks++;
+	}
+
+	//takes a rack back out, moving the racks after it in its run of slots back so each stays reachable from its hash. a rack with
+	//the same id as others keeps its place in front of or behind them
+	void erase(const Rack_Store<RACK_CAPACITY>& racks, int rack) {
+		size_t mask = slots.size() - 1;
+		size_t hole = hash<string_view>()(racks.id(rack)) & mask;
+		while (slots[hole] != rack) {
+			hole = (hole + 1) & mask;
+		}
+		for (size_t s = (hole + 1) & mask; slots[s] != -1; s = (s + 1) & mask) {
+			//the rack in s can move to the hole when the hole is on its way from its hash to s
+			size_t home = hash<string_view>()(racks.id(slots[s])) & mask;
+			if (((s - home) & mask) >= ((s - hole) & mask)) {
+				slots[hole] = slots[s];
+				hole = s;
+			}
+		}
+		slots[hole] = -1;
+		num_racks--;
+	}
+
+	//sizes an empty index for this many racks, so inserting them never rehashes
+	void reserve(int expected_racks) {
+		slots.assign(max<size_t>(64, bit_ceil(2 * (size_t)expected_racks + 2)), -1);
+	}
+
+	//puts a rack in the first empty slot from its hash on
+	void place(const Rack_Store<RACK_CAPACITY>& racks, int rack) {
+		size_t mask = slots.size() - 1;
+		size_t s = hash<string_view>()(racks.id(rack)) & mask;
+		while (slots[s] != -1) {
+			s = (s + 1) & mask;
+		}
+		slots[s] = rack;
+	}
+};
+
+//splits one line of rack data (without its newline) into the rack id and the sample number: the id, spaces or tabs, then the
+//number, with anything after it ignored. a blank line sets num_samples to 0. returns false and sets error if the line is malformed
+//or the sample number is not between 1 and rack_capacity
+inline bool parse_rack_line(const char* line, const char* line_end, int rack_capacity, string_view& id, int& num_samples, string& error) {
+	auto is_blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+	const char* p = line;
+	while (p < line_end && is_blank(*p)) {
+		p++;
+	}
+	num_samples = 0;
+	if (p == line_end) {
+		return true;
+	}
+	const char* id_begin = p;
+	while (p < line_end && !is_blank(*p)) {
+		p++;
+	}
+	id = string_view(id_begin, p - id_begin);
+	while (p < line_end && is_blank(*p)) {
+		p++;
+	}
 
-class Program {
+	from_chars_result parsed = from_chars(p, line_end, num_samples);
+	if (parsed.ptr == p || (parsed.ptr < line_end && !is_blank(*parsed.ptr))) {
+		error = "expected a rack id followed by a sample number";
+		return false;
+	}
+	if (parsed.ec != errc() || num_samples < 1 || num_samples > rack_capacity) {
+		error = "sample number " + string(p, parsed.ptr) + " is not between 1 and " + to_string(rack_capacity);
+		return false;
+	}
+	return true;
+}
+
+//instrumentation: phase timers and hot path counters, only built when RACK_INSTRUMENTATION is defined (Rack_Bench and the
+//Instrumented configuration of Rack_Final define it).
+//otherwise RACK_TIME_PHASE and RACK_COUNT expand to nothing and Program has no stats member at all
+#ifdef RACK_INSTRUMENTATION
+
+//wall-clock seconds spent in each phase of planning, added to as the phases run
+struct Phase_Times {
+	double load = 0;
+	double populate = 0;
+	double choose = 0;
+	double create = 0;
+	double remainder = 0;
+	double improve = 0;
+	double write = 0;
+};
+
+//adds the time between its construction and its destruction to one Phase_Times field
+struct Phase_Timer {
+	double& total;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	explicit Phase_Timer(double& total) : total(total) {}
+	~Phase_Timer() { total += chrono::duration<double>(chrono::steady_clock::now() - start).count(); }
+};
+
+//the step of create_new_batch that gave up and fell back to backup_array
+enum Backup_Path {
+	BACKUP_ADD_ALL_EXCEPT_LAST,
+	BACKUP_DECREASE_FAILED,
+	BACKUP_NO_VALID_LAST_SPOT,
+	BACKUP_INCREASE_OVERSHOT,
+	NUM_BACKUP_PATHS
+};
+
+//everything the instrumentation records for one Program
+struct Plan_Stats {
+	Phase_Times times;
+	//batches made by create_new_batch, and how many of them fell back to backup_array, by the path that triggered it
+	long long heuristic_batches = 0;
+	array<long long, NUM_BACKUP_PATHS> backup_fallbacks{};
+	//replacements made inside the loops of decrease_testing_total and increase_testing_total
+	long long decrease_iterations = 0;
+	long long increase_iterations = 0;
+	//racks taken out of source_buckets by find_source
+	long long find_source_calls = 0;
+	//changes made to testing_array by add_in_order and remove_from_testing, and changes undone by rollback_testing
+	long long testing_adds = 0;
+	long long testing_removes = 0;
+	long long rollback_steps = 0;
+};
+
+//times the rest of the enclosing scope into one Phase_Times field of stats
+#define RACK_TIME_PHASE(phase) Phase_Timer phase##_timer(stats.times.phase)
+//adds to one Plan_Stats counter
+#define RACK_COUNT(counter, amount) (stats.counter += (amount))
+
+#else
+
+#define RACK_TIME_PHASE(phase) ((void)0)
+#define RACK_COUNT(counter, amount) ((void)0)
+
+#endif
+
+//one kind of destination rack a batch may fill: the spots in it and how many of them a single batch may use
+struct Destination_Format {
+	int capacity;
+	int limit;
+};
+
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+class Basic_Program {
 public:
-	//constructor
-	Program() {
+	static constexpr int rack_capacity = RACK_CAPACITY;
+	static constexpr int batch_capacity = BATCH_CAPACITY;
+	using Racks = Rack_Store<RACK_CAPACITY>;
 
-		//initialize sample_frequencies array
-		for (int i = 0; i < RACK_CAPACITY + 1; i++) {
-			sample_frequencies.push_back(0);
+	//definition for Batch
+	struct Batch {
+		int batch_num;
+		//hold sources in batch, as indices into the Rack_Store (see get_racks)
+		vector<int> batch_sources;
+	};
+
+	//constructor, destinations start out as the single RACK_CAPACITY format
+	Basic_Program() {
+		for (int d = 0; d <= BATCH_CAPACITY; d++) {
+			destination_room[d] = d * RACK_CAPACITY;
 		}
 	}
 
-	//read and analyze data about the rack sample numbers
+	//read and analyze data about the rack sample numbers. read_data prompts for a file in inputs/, the others read racks without
+	//prompting from a path (memory mapped), any stream or a buffer, and report a bad line through error
 	void read_data();
+	bool read_file(const string& path, string& error);
+	bool read_stream(istream& in, string& error);
+	bool read_buffer(const char* data, size_t size, string& error);
+
+	//number of threads read_buffer may split a large input across
+	void set_read_threads(int num_threads) { read_threads = max(1, num_threads); }
 	void populate_frequencies();
 
 	//create all batches
 	void distribute_racks();
 
-	//print methods for displaying results
+	//use the exact histogram-DP solver (Exact_Batch.cpp) instead of the ratio heuristic for batches made while more than
+	//BATCH_CAPACITY - 1 racks remain
+	void set_exact_mode(bool exact) { exact_mode = exact; }
+
+	//destination racks to plan with, instead of only RACK_CAPACITY racks. returns false and sets error if the formats can't hold
+	//a full source rack in one batch. an empty list goes back to the single format. must be called before distribute_racks
+	bool set_destination_formats(const vector<Destination_Format>& formats, string& error);
+
+	//whether more than the single RACK_CAPACITY destination format is in use
+	bool mixed_destinations() { return !destination_formats.empty(); }
+
+	//online intake, see Online.cpp: add_rack_line adds one rack as it arrives, emit_ready_batches takes out every batch that can
+	//already be made filling at least the online fill fraction (0 to 1) of its destination spots, and flush_online plans the rest
+	//once the input ends. no populate_frequencies or distribute_racks call is needed around them
+	void set_online_fill(double fill) { online_fill = fill; }
+	bool add_rack_line(string_view line, string& error);
+	int emit_ready_batches();
+	void flush_online();
+
+	//carry-over inventory, see Carry_Over.cpp: read_inventory adds the racks an earlier run held back (before the input is read),
+	//hold_underfilled takes the batches using less than hold_fill of the BATCH_CAPACITY rack positions back out of a finished plan, and
+	//write_inventory saves their racks for the next run
+	bool read_inventory(const string& path, string& error);
+	void hold_underfilled(double hold_fill, int max_hold);
+	void write_inventory(ostream& out);
+	int get_num_held() { return held_racks.size(); }
+
+	//incremental re-planning, see Replan.cpp: read_plan loads a results csv written earlier into a Program that holds no racks yet,
+	//index_plan readies a plan made any other way, and apply_delta adds and removes racks by id, changing only the batches they
+	//touch. get_num_changed is the number of batches the last delta changed, emptied, renumbered or added
+	bool read_plan(istream& in, string& error);
+	int index_plan();
+	bool apply_delta(istream& in, string& error);
+	int get_num_changed() { return num_changed; }
+	//begin_trial and end_trial bracket deltas that are only being tried: end_trial puts the plan back the way begin_trial found it,
+	//copying back only the batches the deltas changed
+	void begin_trial();
+	void end_trial();
+
+	//proven lower bound on the number of batches any plan for the racks read in could use, set by distribute_racks
+	int get_lower_bound() { return batch_lower_bound; }
+
+	//statistics about the finished plan
+	int get_num_batches() { return finished_batches.size(); }
+	int get_total_destinations();
+	int count_invalid_batches();
+
+	//run many varied passes of distribute_racks across threads and keep the best plan, see Portfolio.cpp
+	void distribute_portfolio(int num_passes, int num_threads, unsigned seed);
+
+	//move and swap racks between finished batches for up to the given number of seconds, see Local_Search.cpp
+	void improve_batches(double seconds);
+
+	//the finished batches, in batch number order, and the racks their batch_sources index into
+	const vector<Batch>& get_batches() { return finished_batches; }
+	const Racks& get_racks() { return racks; }
+
+#ifdef RACK_INSTRUMENTATION
+	//phase times and counters recorded so far. after distribute_portfolio they are those of the pass that was kept
+	const Plan_Stats& get_stats() { return stats; }
+
+	//write get_stats as one JSON object
+	void write_stats(ostream& out);
+#endif
+
+	//print methods for displaying results. print_summary and export_results prompt, write_summary and write_results write
+	//straight to a stream
 	void print_summary();
 	void export_results();
+	void write_summary(ostream& out);
+	void write_results(ostream& out);
+
+	//write_results in two parts, for plans written out while they are still being made: the header, and the rows of the batches
+	//from first_batch on
+	void write_results_header(ostream& out);
+	void write_result_rows(ostream& out, int first_batch);
+
+	//write the batch count, lower bound and gap as a csv of their own, next to the results csv
+	void write_bound(ostream& out);
+
+	//write the finished batches in the binary plan format, see Plan_File.h
+	void write_plan_file(ostream& out);
 
 private:
-	//temporary vector finding the best combination of sample numbers before modifying actual all_sources array, cleared with each new batch
-	vector<int> testing_array;
+	//temporary batch finding the best combination of sample numbers before taking racks out of source_buckets, cleared with each new batch
+	Testing_Batch<RACK_CAPACITY> testing_array;
 	// vector that holds the testing array found during choose_num_sources, a backup if strategy doesn't work
 	vector<int> backup_array;
 
-	//definition for Source_Rack
-	struct Source_Rack {
-		string id;
-		int num_samples;
+	//one add or remove made to testing_array through add_in_order or remove_from_testing
+	struct Testing_Change {
+		int sample_num;
+		bool added;
 	};
 
-	//definition for Batch
-	struct Batch {
-		int batch_num;
-		//hold sources in batch
-		vector<Source_Rack> batch_sources;
-	};
+	//undo log of every change made to testing_array since it was last cleared, so a trial configuration can be abandoned by
+	//undoing only the changes it made (see rollback_testing)
+	vector<Testing_Change> testing_log;
+
+	//every source read into the program, in read order. racks are never erased from here, apart from the trimming done by
+	//end_trial and compact_racks for re-planning; source_buckets tracks which are left
+	Racks racks;
 
-	//all undistributed sources in program, samples are removed once added to a batch
-	vector<Source_Rack> all_sources;
+	//indices into racks of the undistributed racks, bucketed by sample number (index 0 is unused). each bucket keeps read
+	//order, so taking the front of a bucket picks the earliest-read rack with that sample number
+	array<deque<int>, RACK_CAPACITY + 1> source_buckets;
+
+	//number of racks still waiting in source_buckets
+	int sources_remaining = 0;
 
 	//all currently finished batches in the program
 	vector<Batch> finished_batches;
 
-	//vector to store frequencies of each sample number, with the index matching up with the sample number (index 0 is unused)
-	vector<int> sample_frequencies;
+	//frequencies of each sample number, with the index matching up with the sample number (index 0 is unused).
+	//counts racks that are still available, i.e. not yet taken into a batch and not reserved in testing_array
+	array<int, RACK_CAPACITY + 1> sample_frequencies{};
+
+	//bit i is set exactly when sample_frequencies[i] > 0, only changed through increment_frequency/decrement_frequency
+	Sample_Mask<RACK_CAPACITY> available_mask;
+
+#ifdef RACK_INSTRUMENTATION
+	//phase times and counters, see get_stats
+	Plan_Stats stats;
+#endif
+
+	//threads used to parse large inputs, see read_buffer
+	int read_threads = 1;
+
+	//whether distribute_racks uses create_exact_batch instead of choose_num_sources/create_new_batch
+	bool exact_mode = false;
+
+	//sample totals reachable by the exact solver, see build_exact_table. compose_exact_batch reuses the table choose_exact_num_sources
+	//built as long as sample_frequencies is still what it was built from
+	struct Exact_Table {
+		//the available sample numbers, smallest first
+		vector<int> values;
+		//for each t up to values.size() and each j up to num_sources, the bitset of totals up to capacity that j racks of the
+		//first t values can reach
+		vector<uint64_t> layers;
+		int num_sources = 0;
+		int capacity = -1;
+		int num_words = 0;
+		array<int, RACK_CAPACITY + 1> frequencies{};
+	};
+	Exact_Table exact_table;
+
+	//lower bound on the number of batches, computed from the input histogram at the start of distribute_racks
+	int batch_lower_bound = 0;
+
+	//runs each rack read by read_inventory has been held for, by index in racks. racks read after the inventory have no entry
+	vector<int> runs_held;
+
+	//racks taken out of the plan by hold_underfilled, to be written out by write_inventory
+	vector<int> held_racks;
+
+	//for a plan loaded by read_plan: every rack in it by id, the index in finished_batches of the batch each rack is in (-1 once
+	//removed), and the histogram of their sample numbers for the lower bound
+	Rack_Index<RACK_CAPACITY> rack_by_id;
+	vector<int> rack_batch;
+	array<int, RACK_CAPACITY + 1> plan_frequencies{};
+
+	//finished batches with a free rack position, by the empty spots left in their destination racks (RACK_CAPACITY or more all go
+	//in the last bucket), and the batches with room for another source and another destination rack. entries go stale as batches
+	//change and are checked when taken, see find_batch_for
+	array<vector<int>, RACK_CAPACITY + 1> slack_buckets;
+	vector<int> roomy_batches;
+
+	//deltas applied so far, the last delta that changed each batch, and the number of batches the last delta changed
+	int num_deltas = 0;
+	vector<int> batch_delta;
+	int num_changed = 0;
+
+	//while a trial is open: every batch as it was before the trial first changed it (with its batch_delta), and the rest of what
+	//apply_delta changes, for end_trial to put back. the batch indices are small next to the racks, so they are copied whole
+	struct Saved_Batch {
+		int index;
+		Batch batch;
+		int delta;
+	};
+	struct Replan_Trial {
+		bool open = false;
+		vector<bool> saved;
+		vector<Saved_Batch> batches;
+		int num_racks = 0;
+		int num_batches = 0;
+		array<int, RACK_CAPACITY + 1> plan_frequencies{};
+		array<vector<int>, RACK_CAPACITY + 1> slack_buckets;
+		vector<int> roomy_batches;
+		int lower_bound = 0;
+		int num_deltas = 0;
+		int num_changed = 0;
+		mt19937 rng;
+	};
+	Replan_Trial trial;
+
+	//fraction of its destination spots a batch must fill to be taken out by emit_ready_batches before the input has ended
+	double online_fill = 0.95;
+
+	//when set, add_ratios starts at a random sample number and rounds ratios randomly, so portfolio passes explore different plans
+	bool randomized = false;
+
+	//set on the copies distribute_portfolio runs its passes on, which read the sample numbers of the racks they were copied from
+	//instead of holding their own Rack_Store. null everywhere else, see rack_samples
+	const Racks* shared_racks = nullptr;
+
+	//destination formats set by set_destination_formats, densest first, empty for the single RACK_CAPACITY format
+	vector<Destination_Format> destination_formats;
+
+	//destination_room[d] is the most samples d destination racks can hold in one batch: the densest formats first, each up to
+	//its limit. a batch with s sources has destination_room[BATCH_CAPACITY - s] spots to fill
+	array<int, BATCH_CAPACITY + 1> destination_room;
+	//random source for randomized passes and for the large-neighborhood moves in improve_batches
+	mt19937 rng;
 
 	//higher-level methods for creating batches
 	void create_new_batch(int num_source_spots);
 	int choose_num_sources();
 	bool add_all_except_last(int num_source_spots);
 	void add_ratios(int num_source_spots);
+	void compose_new_batch(int num_source_spots);
+	void fit_testing();
 	Batch finalize_spots();
-	Source_Rack find_source(int sample_num);
+	int find_source(int sample_num);
 	void distribute_remainder();
+	void create_exact_batch(int num_sources);
+	void compose_exact_batch(int num_sources);
+	int choose_exact_num_sources();
+	void build_exact_table(int num_sources, int capacity);
+	int fullest_exact_total(int num_sources, int limit);
+	static vector<int> pack_remainder(const vector<int>& loads);
+	vector<int> pack_mixed_remainder(const vector<int>& samples);
+	vector<int> remaining_in_order();
 
 	//lower-level helper methods for creating batches
+	int compute_lower_bound(const array<int, RACK_CAPACITY + 1>& frequencies);
+	int batch_total(const Batch& batch);
+	int batch_destinations(const Batch& batch);
+	int destinations_for(int total);
+	int batch_spots(int total);
+	int rack_runs_held(int rack) { return rack < runs_held.size() ? runs_held[rack] : 0; }
+	int rack_samples(int rack) const { return (shared_racks != nullptr ? *shared_racks : racks).samples(rack); }
+	bool take_online_batch(double min_fill);
+	bool fits_batch(int num_sources, int total);
+	void index_batch(int batch);
+	int find_batch_for(int num_samples);
+	void mark_changed(int batch);
+	void compact_racks();
+	void save_for_trial(int batch);
+	vector<int> destination_mix(int total);
+	string mix_text(const vector<int>& mix);
+	double optimality_gap();
 	bool is_valid(int num);
 	int find_smallest();
 	int ideal_last(int num_source_spots);
 	int total_testing_samples();
 	bool decrease_testing_total(int& ideal_last_spot, int& to_add, int& num_source_racks);
 	void increase_testing_total(int& ideal_last_spot, int& to_add, int& num_source_racks, bool &approximate);
-	void add_in_order(vector<int>& which_vector, int to_add);
+	void add_in_order(int to_add);
 	void remove_from_testing(int to_remove);
+	void clear_testing();
+	void rollback_testing(size_t checkpoint);
+	void restore_backup();
 	int find_next_smallest_valid(int current);
 	int find_next_highest_valid(int current);
+	void increment_frequency(int num);
+	void decrement_frequency(int num);
+
+	//debug-only check that sample_frequencies matches the remaining racks
+#ifndef NDEBUG
+	void check_frequencies();
+#endif
 
 	//print methods for testing purposes
 	void print_frequencies();
@@ -100,4 +703,7 @@ private:
 	void print_testing_array();
 };
 
+//the planner for the usual 96-spot racks in 20-rack batches
+using Program = Basic_Program<DEFAULT_RACK_CAPACITY, DEFAULT_BATCH_CAPACITY>;
+
 #endif
\ No newline at end of file
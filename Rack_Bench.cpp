@@ -0,0 +1,589 @@
+//Rack_Bench.cpp: benchmark driver for the rack algorithm. Generates synthetic rack populations of
+//several shapes and sizes, plans each one, and prints one JSON object per run with the time spent
+//in every phase and the quality of the plan, so results can be collected and compared across builds.
+//With --golden it instead replans the files in inputs/, checks each plan is valid, and compares it
+//against the stored plan in results/ and optionally against the runtimes of an earlier run. With
+//--read-plan it maps a binary plan file written by --plan-output and checks it against its csv
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include "Program.h"
+#include "Rack_Planner.h"
+#include "Mapped_File.h"
+#include "Plan_File.h"
+
+//the per-phase times and counters come from the instrumentation in Program.h, which Rack_Bench.vcxproj turns on
+#ifndef RACK_INSTRUMENTATION
+#error Rack_Bench needs RACK_INSTRUMENTATION defined
+#endif
+
+//the synthetic racks and the golden corpus are all in the usual 96-spot, 20-rack format
+const int RACK_CAPACITY = Program::rack_capacity;
+const int BATCH_CAPACITY = Program::batch_capacity;
+
+using namespace std;
+
+//stream buffer that throws away everything written to it but counts the bytes, so the export phase can be timed without a disk
+struct Counting_Buffer : streambuf {
+	size_t bytes = 0;
+
+	streamsize xsputn(const char*, streamsize n) override {
+		bytes += n;
+		return n;
+	}
+	int overflow(int c) override {
+		bytes++;
+		return c;
+	}
+};
+
+//relative weight of each sample number (index 1 to RACK_CAPACITY) for one of the synthetic distributions, or an empty vector if
+//the name is unknown
+vector<double> distribution_weights(const string& name) {
+	vector<double> weights(RACK_CAPACITY + 1, 0);
+	for (int num = 1; num <= RACK_CAPACITY; num++) {
+		if (name == "low-skew") {
+			//the typical lab shape: heavy skew towards racks with few samples
+			weights[num] = 1.0 / pow(num, 1.1);
+		}
+		else if (name == "uniform") {
+			weights[num] = 1;
+		}
+		else if (name == "bimodal") {
+			//nearly empty and nearly full racks, with a thin middle
+			weights[num] = (num < 10 || num > RACK_CAPACITY - 11) ? 5 : 0.2;
+		}
+		else if (name == "heavy-high") {
+			weights[num] = (double)num * num;
+		}
+		else {
+			return {};
+		}
+	}
+	return weights;
+}
+
+//rack data in the input file format, one line per rack with a sample number drawn from weights
+string generate_racks(int num_racks, const vector<double>& weights, unsigned seed) {
+	mt19937 rng(seed);
+	discrete_distribution<int> pick(weights.begin(), weights.end());
+	string data;
+	data.reserve((size_t)num_racks * 14);
+	char line[32];
+	for (int i = 0; i < num_racks; i++) {
+		int length = snprintf(line, sizeof(line), "R%08d %d\n", i, pick(rng));
+		data.append(line, length);
+	}
+	return data;
+}
+
+//splits a comma separated list
+vector<string> split_list(const string& list) {
+	vector<string> items;
+	stringstream stream(list);
+	string item;
+	while (getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+//one plan as it appears in a results csv: the racks of each batch, plus the batch statistics the csv reports
+struct Csv_Plan {
+	struct Csv_Batch {
+		vector<pair<string, int>> racks;
+		int reported_sources = 0;
+		int reported_destinations = 0;
+		int reported_total = 0;
+	};
+	//by batch number
+	map<int, Csv_Batch> batches;
+};
+
+//reads the rack rows of a results csv (the header and the blank lines between batches are skipped), returns false if any other
+//line isn't a rack row
+bool parse_results_csv(istream& in, Csv_Plan& plan, string& error) {
+	string line;
+	int line_num = 0;
+	while (getline(in, line)) {
+		line_num++;
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line_num == 1 || line.empty()) {
+			continue;
+		}
+		vector<string> fields;
+		stringstream stream(line);
+		string field;
+		while (getline(stream, field, ',')) {
+			fields.push_back(field);
+		}
+		try {
+			if (fields.size() < 6) {
+				throw invalid_argument(line);
+			}
+			Csv_Plan::Csv_Batch& batch = plan.batches[stoi(fields[2])];
+			batch.racks.push_back({ fields[0], stoi(fields[1]) });
+			batch.reported_sources = stoi(fields[3]);
+			batch.reported_destinations = stoi(fields[4]);
+			batch.reported_total = stoi(fields[5]);
+		}
+		catch (const exception&) {
+			error = "line " + to_string(line_num) + " is not a rack row";
+			return false;
+		}
+	}
+	return true;
+}
+
+//what checking one plan against its input found
+struct Plan_Check {
+	//every input rack appears exactly once and no other rack appears
+	bool racks_match = true;
+	//batches whose reported sources, destinations or total disagree with their racks, or whose samples overfill their destinations
+	int inconsistent_batches = 0;
+	//batches with more than BATCH_CAPACITY racks in total
+	int over_capacity_batches = 0;
+	int batches = 0;
+	int destinations = 0;
+	long long samples = 0;
+
+	double fill() const { return destinations == 0 ? 0 : (double)samples / ((double)destinations * RACK_CAPACITY); }
+};
+
+//checks a plan read back from a results csv against the racks that were read in
+Plan_Check check_plan(const Csv_Plan& plan, const Program::Racks& racks) {
+	Plan_Check check;
+	//(id, sample number) -> how many input racks have it minus how many the plan uses
+	unordered_map<string, int> unused;
+	for (int i = 0; i < racks.size(); i++) {
+		unused[string(racks.id(i)) + '\0' + to_string(racks.samples(i))]++;
+	}
+	for (const auto& [batch_num, batch] : plan.batches) {
+		int total = 0;
+		for (int i = 0; i < batch.racks.size(); i++) {
+			total += batch.racks[i].second;
+			if (--unused[batch.racks[i].first + '\0' + to_string(batch.racks[i].second)] < 0) {
+				check.racks_match = false;
+			}
+		}
+		int sources = batch.racks.size();
+		int destinations = (total + RACK_CAPACITY - 1) / RACK_CAPACITY;
+		if (batch.reported_sources != sources || batch.reported_total != total || batch.reported_destinations != destinations
+			|| total > batch.reported_destinations * RACK_CAPACITY) {
+			check.inconsistent_batches++;
+		}
+		if (sources + destinations > BATCH_CAPACITY) {
+			check.over_capacity_batches++;
+		}
+		check.batches++;
+		check.destinations += destinations;
+		check.samples += total;
+	}
+	for (const auto& [key, count] : unused) {
+		if (count != 0) {
+			check.racks_match = false;
+		}
+	}
+	return check;
+}
+
+//the stored plan for an input file: results_N.csv for rack_input_N.txt, <name>_Results.csv otherwise
+string golden_name(const string& input_stem) {
+	const string prefix = "rack_input_";
+	if (input_stem.compare(0, prefix.size(), prefix) == 0) {
+		return "results_" + input_stem.substr(prefix.size()) + ".csv";
+	}
+	return input_stem + "_Results.csv";
+}
+
+//input name -> runtime_s from the JSON lines of an earlier --golden run
+unordered_map<string, double> read_runtime_baseline(const string& path) {
+	unordered_map<string, double> runtimes;
+	ifstream in(path);
+	string line;
+	while (getline(in, line)) {
+		size_t input_at = line.find("\"input\":\"");
+		size_t runtime_at = line.find("\"runtime_s\":");
+		if (input_at == string::npos || runtime_at == string::npos) {
+			continue;
+		}
+		input_at += 9;
+		runtimes[line.substr(input_at, line.find('"', input_at) - input_at)] = stod(line.substr(runtime_at + 12));
+	}
+	return runtimes;
+}
+
+//limits on how much worse a plan or its runtime may get before the golden run fails
+struct Golden_Limits {
+	//allowed fractional increase in the batch count over the stored plan
+	double batch_tolerance = 0;
+	//allowed fractional increase in the destination rack count over the stored plan
+	double destination_tolerance = 0;
+	//allowed drop in mean destination fill (0 to 1) below the stored plan
+	double fill_tolerance = 0.005;
+	//allowed fractional increase in runtime over the baseline, plus an absolute allowance for timer noise on tiny inputs
+	double time_tolerance = 0.25;
+	double time_slack = 0.002;
+};
+
+/*
+* name: run_golden
+* purpose: replans every input in inputs_dir and checks each plan, printing one JSON object per input and a final summary
+* arguments: the input and stored result folders, the planning options, the number of timed runs per input (the fastest is
+*            kept), the runtimes of an earlier run (may be empty) and the limits
+* returns: 0 if every input passed, 2 if a file could not be read, 4 if any plan is invalid or got worse
+* notes: a plan fails if any input rack is missing or repeated, if the csv statistics disagree with the racks, if any batch is
+*        over BATCH_CAPACITY, or if its batch count, destination rack count, fill or runtime is worse than the limits allow. a stored plan with a batch over
+*        BATCH_CAPACITY fails too, since it can't be the reference a new plan is held to
+*/
+int run_golden(const string& inputs_dir, const string& results_dir, const Plan_Options& options, int repeats,
+	const unordered_map<string, double>& runtime_baseline, const Golden_Limits& limits) {
+	vector<filesystem::path> inputs;
+	error_code list_error;
+	for (const auto& entry : filesystem::directory_iterator(inputs_dir, list_error)) {
+		if (entry.path().extension() == ".txt" && entry.path().stem() != "input_descriptions") {
+			inputs.push_back(entry.path());
+		}
+	}
+	if (list_error || inputs.empty()) {
+		cerr << "no input files found in " << inputs_dir << endl;
+		return 2;
+	}
+	sort(inputs.begin(), inputs.end());
+
+	int failed = 0;
+	for (int f = 0; f < inputs.size(); f++) {
+		string name = inputs[f].filename().string();
+
+		//fastest of the timed runs, planning and writing the csv
+		double runtime = 1e30;
+		Rack_Plan plan;
+		string csv;
+		for (int run = 0; run < repeats; run++) {
+			auto start = chrono::steady_clock::now();
+			plan = plan_rack_file(inputs[f].string(), options);
+			if (!plan.ok) {
+				cerr << "Error reading " << name << ": " << plan.error << endl;
+				return 2;
+			}
+			ostringstream out;
+			plan.program.write_results(out);
+			runtime = min(runtime, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+			csv = out.str();
+		}
+
+		Csv_Plan new_plan;
+		string error;
+		istringstream csv_in(csv);
+		parse_results_csv(csv_in, new_plan, error);
+		Plan_Check check = check_plan(new_plan, plan.program.get_racks());
+
+		vector<string> problems;
+		if (!check.racks_match) {
+			problems.push_back("racks missing or repeated");
+		}
+		if (check.inconsistent_batches > 0) {
+			problems.push_back(to_string(check.inconsistent_batches) + " batches with wrong statistics or overfilled destinations");
+		}
+		if (check.over_capacity_batches > 0) {
+			problems.push_back(to_string(check.over_capacity_batches) + " batches over capacity");
+		}
+
+		//the stored plan for this input, if there is one
+		string golden = golden_name(inputs[f].stem().string());
+		ifstream golden_in(filesystem::path(results_dir) / golden);
+		bool has_golden = golden_in.is_open();
+		Plan_Check stored;
+		if (has_golden) {
+			Csv_Plan stored_plan;
+			if (!parse_results_csv(golden_in, stored_plan, error)) {
+				cerr << "Error reading " << golden << ": " << error << endl;
+				return 2;
+			}
+			stored = check_plan(stored_plan, plan.program.get_racks());
+			if (stored.over_capacity_batches > 0) {
+				problems.push_back(to_string(stored.over_capacity_batches) + " batches over capacity in " + golden);
+			}
+			if (check.batches > stored.batches * (1 + limits.batch_tolerance)) {
+				problems.push_back("more batches than the stored plan");
+			}
+			if (check.destinations > stored.destinations * (1 + limits.destination_tolerance)) {
+				problems.push_back("more destination racks than the stored plan");
+			}
+			if (check.fill() < stored.fill() - limits.fill_tolerance) {
+				problems.push_back("lower destination fill than the stored plan");
+			}
+		}
+
+		auto baseline = runtime_baseline.find(name);
+		if (baseline != runtime_baseline.end() && runtime > baseline->second * (1 + limits.time_tolerance) + limits.time_slack) {
+			problems.push_back("slower than the runtime baseline");
+		}
+
+		if (!problems.empty()) {
+			failed++;
+		}
+		cout << "{\"input\":\"" << name << "\",\"golden\":\"" << (has_golden ? golden : "") << "\",\"pass\":"
+			<< (problems.empty() ? "true" : "false") << ",\"runtime_s\":" << runtime << ",\"batches\":" << check.batches
+			<< ",\"fill\":" << check.fill() << ",\"over_capacity_batches\":" << check.over_capacity_batches;
+		if (has_golden) {
+			cout << ",\"golden_batches\":" << stored.batches << ",\"golden_fill\":" << stored.fill()
+				<< ",\"golden_over_capacity_batches\":" << stored.over_capacity_batches;
+		}
+		if (baseline != runtime_baseline.end()) {
+			cout << ",\"baseline_runtime_s\":" << baseline->second;
+		}
+		cout << ",\"problems\":[";
+		for (int i = 0; i < problems.size(); i++) {
+			cout << (i > 0 ? "," : "") << "\"" << problems[i] << "\"";
+		}
+		cout << "]}" << endl;
+	}
+	cout << "{\"golden_inputs\":" << inputs.size() << ",\"failed\":" << failed << "}" << endl;
+	return failed == 0 ? 0 : 4;
+}
+
+/*
+* name: read_back_plan
+* purpose: maps a binary plan file, reads it through Plan_File_View and compares it with the results csv written in the same run,
+*          printing one JSON object with what was found
+* arguments: the plan file and the csv
+* returns: 0 if the two agree, 2 if either could not be read, 4 if they disagree
+* notes: batches are matched in order and the racks within a batch position by position, since both are written from the same
+*        finished batches. each batch total in the plan file is also checked against the sample numbers of its racks
+*/
+int read_back_plan(const string& plan_path, const string& csv_path) {
+	Mapped_File mapped;
+	Plan_File_View view;
+	string error;
+	if (!mapped.open(plan_path, error) || !view.open(mapped.data(), mapped.size(), error)) {
+		cerr << "Error reading " << plan_path << ": " << error << endl;
+		return 2;
+	}
+	ifstream csv_in(csv_path);
+	Csv_Plan csv_plan;
+	if (!csv_in.is_open()) {
+		cerr << "Error reading " << csv_path << ": could not open the file" << endl;
+		return 2;
+	}
+	if (!parse_results_csv(csv_in, csv_plan, error)) {
+		cerr << "Error reading " << csv_path << ": " << error << endl;
+		return 2;
+	}
+
+	vector<string> problems;
+	if (view.header().rack_capacity != RACK_CAPACITY || view.header().batch_capacity != BATCH_CAPACITY) {
+		problems.push_back("plan file is for " + to_string(view.header().rack_capacity) + "-spot racks and "
+			+ to_string(view.header().batch_capacity) + "-rack batches");
+	}
+	if (view.num_batches() != csv_plan.batches.size()) {
+		problems.push_back("plan file has " + to_string(view.num_batches()) + " batches, csv has " + to_string(csv_plan.batches.size()));
+	}
+	int mismatched_batches = 0;
+	auto csv_batch = csv_plan.batches.begin();
+	for (int b = 0; b < view.num_batches() && csv_batch != csv_plan.batches.end(); b++, csv_batch++) {
+		const vector<pair<string, int>>& csv_racks = csv_batch->second.racks;
+		uint32_t first = view.batch_starts()[b];
+		uint32_t end = view.batch_starts()[b + 1];
+		bool same = end - first == csv_racks.size();
+		long long total = 0;
+		for (uint32_t pos = first; pos < end; pos++) {
+			total += view.rack_count(pos);
+			if (same && (view.rack_id(pos) != csv_racks[pos - first].first || view.rack_count(pos) != csv_racks[pos - first].second)) {
+				same = false;
+			}
+		}
+		if (!same || total != view.batch_totals()[b]) {
+			mismatched_batches++;
+		}
+	}
+	if (mismatched_batches > 0) {
+		problems.push_back(to_string(mismatched_batches) + " batches with different racks or totals");
+	}
+
+	cout << "{\"plan\":\"" << plan_path << "\",\"csv\":\"" << csv_path << "\",\"match\":" << (problems.empty() ? "true" : "false")
+		<< ",\"batches\":" << view.num_batches() << ",\"racks\":" << view.num_racks() << ",\"lower_bound\":" << view.header().lower_bound
+		<< ",\"problems\":[";
+	for (int i = 0; i < problems.size(); i++) {
+		cout << (i > 0 ? "," : "") << "\"" << problems[i] << "\"";
+	}
+	cout << "]}" << endl;
+	return problems.empty() ? 0 : 4;
+}
+
+void print_usage(ostream& out) {
+	out << "usage: Rack_Bench [--sizes n1,n2,...] [--dists low-skew,uniform,bimodal,heavy-high] [--mode heuristic|exact]" << endl;
+	out << "                  [--seed <seed>] [--threads <count>]" << endl;
+	out << "prints one JSON object per line for every size and distribution. sizes default to 1000 up to 10000000 by powers of 10" << endl;
+	out << "       Rack_Bench --golden [--inputs <dir>] [--results <dir>] [--repeat <runs>] [--runtime-baseline <jsonl>]" << endl;
+	out << "                  [--batch-tolerance <fraction>] [--destination-tolerance <fraction>] [--fill-tolerance <fraction>]" << endl;
+	out << "                  [--time-tolerance <fraction>] [--mode ...]" << endl;
+	out << "replans every input, checks it and compares it with the stored results, exits 4 if any plan is invalid or got worse" << endl;
+	out << "       Rack_Bench --read-plan <plan file> --csv <results csv>" << endl;
+	out << "reads a --plan-output file back through Plan_File_View and compares it with the csv, exits 4 if they differ" << endl;
+}
+
+int main(int argc, char* argv[]) {
+	vector<string> sizes = { "1000", "10000", "100000", "1000000", "10000000" };
+	vector<string> dists = { "low-skew", "uniform", "bimodal", "heavy-high" };
+	Plan_Options options;
+	unsigned seed = 1;
+	bool golden = false;
+	string inputs_dir = "inputs";
+	string results_dir = "results";
+	string runtime_baseline_path;
+	int repeats = 5;
+	Golden_Limits limits;
+	string read_plan_path;
+	string csv_path;
+	try {
+		for (int i = 1; i < argc; i++) {
+			string arg = argv[i];
+			bool has_value = i + 1 < argc;
+			if (arg == "--sizes" && has_value) {
+				sizes = split_list(argv[++i]);
+			}
+			else if (arg == "--dists" && has_value) {
+				dists = split_list(argv[++i]);
+			}
+			else if (arg == "--mode" && has_value) {
+				string mode = argv[++i];
+				if (mode != "heuristic" && mode != "exact") {
+					throw invalid_argument(mode);
+				}
+				options.exact_mode = mode == "exact";
+			}
+			else if (arg == "--seed" && has_value) {
+				seed = stoul(argv[++i]);
+			}
+			else if (arg == "--threads" && has_value) {
+				options.num_threads = stoi(argv[++i]);
+			}
+			else if (arg == "--golden") {
+				golden = true;
+			}
+			else if (arg == "--inputs" && has_value) {
+				inputs_dir = argv[++i];
+			}
+			else if (arg == "--results" && has_value) {
+				results_dir = argv[++i];
+			}
+			else if (arg == "--repeat" && has_value) {
+				repeats = max(1, stoi(argv[++i]));
+			}
+			else if (arg == "--runtime-baseline" && has_value) {
+				runtime_baseline_path = argv[++i];
+			}
+			else if (arg == "--batch-tolerance" && has_value) {
+				limits.batch_tolerance = stod(argv[++i]);
+			}
+			else if (arg == "--destination-tolerance" && has_value) {
+				limits.destination_tolerance = stod(argv[++i]);
+			}
+			else if (arg == "--fill-tolerance" && has_value) {
+				limits.fill_tolerance = stod(argv[++i]);
+			}
+			else if (arg == "--time-tolerance" && has_value) {
+				limits.time_tolerance = stod(argv[++i]);
+			}
+			else if (arg == "--read-plan" && has_value) {
+				read_plan_path = argv[++i];
+			}
+			else if (arg == "--csv" && has_value) {
+				csv_path = argv[++i];
+			}
+			else {
+				throw invalid_argument(arg);
+			}
+		}
+		for (int d = 0; d < dists.size(); d++) {
+			if (distribution_weights(dists[d]).empty()) {
+				throw invalid_argument(dists[d]);
+			}
+		}
+		for (int s = 0; s < sizes.size(); s++) {
+			if (stoi(sizes[s]) < 1) {
+				throw invalid_argument(sizes[s]);
+			}
+		}
+		if (read_plan_path.empty() != csv_path.empty()) {
+			throw invalid_argument("--read-plan and --csv go together");
+		}
+	}
+	catch (const exception&) {
+		print_usage(cerr);
+		return 1;
+	}
+
+	if (!read_plan_path.empty()) {
+		return read_back_plan(read_plan_path, csv_path);
+	}
+	if (golden) {
+		unordered_map<string, double> runtime_baseline;
+		if (!runtime_baseline_path.empty()) {
+			if (!filesystem::exists(runtime_baseline_path)) {
+				cerr << "Error opening runtime baseline " << runtime_baseline_path << endl;
+				return 2;
+			}
+			runtime_baseline = read_runtime_baseline(runtime_baseline_path);
+		}
+		return run_golden(inputs_dir, results_dir, options, repeats, runtime_baseline, limits);
+	}
+
+	for (int d = 0; d < dists.size(); d++) {
+		for (int s = 0; s < sizes.size(); s++) {
+			int num_racks = stoi(sizes[s]);
+			string data = generate_racks(num_racks, distribution_weights(dists[d]), seed);
+
+			auto start = chrono::steady_clock::now();
+			Rack_Plan plan = plan_racks(data.data(), data.size(), options);
+			if (!plan.ok) {
+				cerr << "generated data could not be read: " << plan.error << endl;
+				return 2;
+			}
+			Counting_Buffer counter;
+			ostream sink(&counter);
+			plan.program.write_results(sink);
+			double total_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+			//mean fill of the destination racks the plan uses
+			const Program::Racks& racks = plan.program.get_racks();
+			long long total_samples = 0;
+			for (int i = 0; i < racks.size(); i++) {
+				total_samples += racks.samples(i);
+			}
+			int destinations = plan.program.get_total_destinations();
+			double mean_fill = destinations == 0 ? 0 : (double)total_samples / ((double)destinations * RACK_CAPACITY);
+
+			const Plan_Stats& stats = plan.program.get_stats();
+			const Phase_Times& times = stats.times;
+			cout << "{\"dist\":\"" << dists[d] << "\",\"racks\":" << num_racks << ",\"mode\":\""
+				<< (options.exact_mode ? "exact" : "heuristic") << "\",\"seed\":" << seed << ",\"threads\":" << options.num_threads
+				<< ",\"load_s\":" << times.load << ",\"populate_s\":" << times.populate << ",\"choose_num_sources_s\":" << times.choose
+				<< ",\"create_new_batch_s\":" << times.create << ",\"distribute_remainder_s\":" << times.remainder
+				<< ",\"export_s\":" << times.write << ",\"total_s\":" << total_seconds
+				<< ",\"racks_per_s\":" << num_racks / total_seconds << ",\"input_mb_per_s\":" << data.size() / 1e6 / times.load
+				<< ",\"export_mb_per_s\":" << counter.bytes / 1e6 / times.write
+				<< ",\"batches\":" << plan.program.get_num_batches() << ",\"lower_bound\":" << plan.program.get_lower_bound()
+				<< ",\"invalid_batches\":" << plan.program.count_invalid_batches() << ",\"destinations\":" << destinations
+				<< ",\"mean_fill\":" << mean_fill << ",\"backup_fallbacks\":" << accumulate(stats.backup_fallbacks.begin(), stats.backup_fallbacks.end(), 0LL)
+				<< ",\"decrease_iterations\":" << stats.decrease_iterations << ",\"increase_iterations\":" << stats.increase_iterations << "}" << endl;
+		}
+	}
+	return 0;
+}
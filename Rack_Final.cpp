@@ -3,23 +3,551 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <climits>
 #include <vector>
 #include <array>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <filesystem>
 #include "Program.h"
+#include "Rack_Planner.h"
+#include "Plan_Server.h"
 
 using namespace std;
 
-int main() {
-	Program my_program;
+//exit codes for the non-interactive mode
+const int EXIT_USAGE = 1;
+const int EXIT_INPUT_ERROR = 2;
+const int EXIT_OUTPUT_ERROR = 3;
+const int EXIT_SERVER_ERROR = 4;
 
-	//read and initialize
-	my_program.read_data();
-	my_program.populate_frequencies();
+void print_usage(ostream& out) {
+	out << "usage: Rack_Final [--input <file|->] [--output <file|->] [--mode heuristic|exact] [--exact] [--portfolio <passes>]" << endl;
+	out << "                  [--threads <count>] [--seed <seed>] [--improve <seconds>] [--summary] [--plan-output <file>]" << endl;
+	out << "                  [--rack-capacity 48|96|384] [--batch-capacity 20] [--destinations <spots>[:<limit>],...]" << endl;
+	out << "                  [--online <fill> [--online-chunk <lines>]] [--carry-over <file> [--hold-fill <fill>] [--max-hold <runs>]]" << endl;
+	out << "                  [--bound-output <file>] [--delta <file>] [--serve <socket> [--group-window <ms>]]" << endl;
+	out << "       Rack_Final --client <socket> --request PLAN|WHATIF|DELTA|STOP [--input <file|->] [--output <file|->] [--summary]" << endl;
+	out << "       Rack_Final --bench-parse <file> [--threads <count>]" << endl;
+	out << "with --input the plan is made without any prompts: the racks are read from the file (- for stdin) and the results csv" << endl;
+	out << "is written to --output (stdout if left out or -). --plan-output also writes the plan in the binary format of Plan_File.h" << endl;
+	out << "--bound-output writes the number of batches, the lower bound on it and the gap between them as a csv of their own" << endl;
+	out << "exit codes: 0 ok, 1 bad arguments, 2 bad input, 3 output not written, 4 server not reachable or socket not usable" << endl;
+	out << "without --input the program asks for the file names as before. --bench-parse times reading the file and exits" << endl;
+	out << "--destinations mixes destination rack formats, e.g. 96,384:2 allows up to 2 384-spot racks per batch next to 96-spot racks" << endl;
+	out << "--online reads the input line by line and writes each batch as soon as it fills <fill> (0 to 1) of its destination spots," << endl;
+	out << "trying every --online-chunk lines (1 if left out). the rest is planned once the input ends" << endl;
+	out << "--carry-over reads the racks held in <file> ahead of the input, holds back the racks of batches that use less than" << endl;
+	out << "--hold-fill (0.8) of the racks in a batch unless one was already held --max-hold (2) runs, and saves them to <file>" << endl;
+	out << "--delta reads --input as a results csv written earlier and repairs it for the racks added (+ <id> <samples>) and removed" << endl;
+	out << "(- <id>) in <file>, one per line, changing only the batches they touch" << endl;
+	out << "--serve plans --input (or repairs it with --delta) and keeps the plan loaded, answering requests on the local socket" << endl;
+	out << "<socket> until a STOP request, instead of writing it. requests that arrive within --group-window (2) ms are answered together" << endl;
+	out << "--client sends one request to a server: PLAN gets its plan, or plans the racks in --input instead, WHATIF gets the plan" << endl;
+	out << "the delta in --input would give without keeping it, DELTA applies it, and STOP stops the server" << endl;
+#ifdef RACK_INSTRUMENTATION
+	out << "--stats <file> writes the phase times and hot path counters as JSON once the plan is written (- for stderr)" << endl;
+#endif
+}
+
+//reads racks the way read_data did before the memory-mapped parser, kept only so --bench-parse can compare against it
+size_t legacy_read(const string& path) {
+	//one rack as the old reader stored it
+	struct Legacy_Rack {
+		string id;
+		int num_samples;
+	};
+	vector<Legacy_Rack> sources;
+	ifstream infile(path);
+	while (!infile.eof()) {
+		Legacy_Rack current_source;
+		infile >> current_source.id;
+		infile >> current_source.num_samples;
+		if (!infile) {
+			break;
+		}
+		sources.push_back(current_source);
+	}
+	return sources.size();
+}
+
+//times the old ifstream reader against the memory-mapped parser on one file (on one thread and on num_threads threads), best of 3
+//runs each, and prints GB/s
+int bench_parse(const string& path, int num_threads) {
+	error_code size_error;
+	double gigabytes = filesystem::file_size(path, size_error) / 1e9;
+	if (size_error) {
+		cerr << "Error opening input file " << path << endl;
+		return EXIT_INPUT_ERROR;
+	}
+
+	//best time of 3 runs of read_file on the given number of threads
+	auto time_mapped = [&](int threads, double& best) {
+		best = 1e30;
+		for (int run = 0; run < 3; run++) {
+			auto start = chrono::steady_clock::now();
+			Program program;
+			program.set_read_threads(threads);
+			string error;
+			if (!program.read_file(path, error)) {
+				cerr << "Error reading " << path << ": " << error << endl;
+				return false;
+			}
+			best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+		}
+		return true;
+	};
+
+	double legacy_best = 1e30;
+	size_t legacy_racks = 0;
+	for (int run = 0; run < 3; run++) {
+		auto start = chrono::steady_clock::now();
+		legacy_racks = legacy_read(path);
+		legacy_best = min(legacy_best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	}
+	double serial_best;
+	double parallel_best;
+	if (!time_mapped(1, serial_best) || !time_mapped(num_threads, parallel_best)) {
+		return EXIT_INPUT_ERROR;
+	}
+	cout << "file: " << path << " (" << gigabytes * 1000 << " MB, " << legacy_racks << " racks)" << endl;
+	cout << "ifstream reader: " << legacy_best << " s, " << gigabytes / legacy_best << " GB/s" << endl;
+	cout << "mapped parser, 1 thread: " << serial_best << " s, " << gigabytes / serial_best << " GB/s" << endl;
+	cout << "mapped parser, " << num_threads << " threads: " << parallel_best << " s, " << gigabytes / parallel_best << " GB/s" << endl;
+	return EXIT_SUCCESS;
+}
+
+//sends one request to a planning server started with --serve, with the contents of input_name (stdin for -) as its data when
+//given, and writes the csv of the reply to output_name (stdout if empty or -). returns the exit code
+int run_client(const string& socket_path, const string& request_name, const string& input_name, const string& output_name, bool summary) {
+	string request = request_name + "\n";
+	if (!input_name.empty()) {
+		ifstream infile;
+		if (input_name != "-") {
+			infile.open(input_name, ios::binary);
+			if (infile.fail()) {
+				cerr << "Error reading " << input_name << ": could not open the file" << endl;
+				return EXIT_INPUT_ERROR;
+			}
+		}
+		stringstream data;
+		data << (input_name == "-" ? cin.rdbuf() : infile.rdbuf());
+		request += data.str();
+	}
+
+	string reply;
+	string error;
+	if (!send_plan_request(socket_path, request, reply, error)) {
+		cerr << "Error reaching the server: " << error << endl;
+		return EXIT_SERVER_ERROR;
+	}
+	size_t status_end = reply.find('\n');
+	string status = reply.substr(0, status_end);
+	if (status.rfind("OK", 0) != 0) {
+		cerr << "Error from the server: " << (status.rfind("ERROR ", 0) == 0 ? status.substr(6) : "no reply") << endl;
+		return EXIT_INPUT_ERROR;
+	}
+	if (summary) {
+		cerr << status << endl;
+	}
+
+	string_view results = status_end == string::npos ? string_view() : string_view(reply).substr(status_end + 1);
+	bool to_stdout = output_name.empty() || output_name == "-";
+	ofstream outfile;
+	if (!to_stdout) {
+		outfile.open(output_name, ios::binary);
+		if (outfile.fail()) {
+			cerr << "Error creating output file " << output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	ostream& out = to_stdout ? cout : outfile;
+	out.write(results.data(), results.size());
+	out.flush();
+	if (out.fail()) {
+		cerr << "Error writing output file " << output_name << endl;
+		return EXIT_OUTPUT_ERROR;
+	}
+	return EXIT_SUCCESS;
+}
+
+//plans the racks with the planner for one plate format (main picks it from --rack-capacity and --batch-capacity) and writes
+//everything the command line asked for, prompting instead when there is no input_name. with online, the csv rows of each batch
+//are written as soon as it is made, while the input is still being read. with a delta_name, the input is a results csv that is
+//repaired for the racks added and removed in that file instead of planned from scratch. with a server socket path, the plan is
+//served (see Plan_Server.h) instead of written. stats_name is only used when built with RACK_INSTRUMENTATION. returns the exit code
+template <class Planner>
+int plan_and_write(const Plan_Options& options, const string& input_name, const string& output_name, const string& plan_output_name,
+	const string& bound_output_name, bool summary, [[maybe_unused]] const string& stats_name, bool online, const string& delta_name, const Server_Options& server) {
+	//check the destination formats before any input is read, so a bad --destinations is reported as such
+	string error;
+	if (!Planner().set_destination_formats(options.destination_formats, error)) {
+		cerr << "Bad --destinations: " << error << endl;
+		return EXIT_USAGE;
+	}
+
+	if (input_name.empty()) {
+		//interactive: prompt for the input file, the overview and the output file
+		Planner my_program;
+		my_program.read_data();
+		//the same failure the --input path reports as an input error, e.g. destination formats this input can't use
+		if (!run_plan(my_program, options, error)) {
+			cerr << "Error planning the racks: " << error << endl;
+			return EXIT_INPUT_ERROR;
+		}
+		my_program.print_summary();
+		my_program.export_results();
+		return EXIT_SUCCESS;
+	}
+
+	//non-interactive: read, plan and write without prompting
+	bool to_stdout = output_name.empty() || output_name == "-";
+	ofstream outfile;
+	if (!to_stdout && online) {
+		//online rows are written while the input is read, so the output has to be open first
+		outfile.open(output_name);
+		if (outfile.fail()) {
+			cerr << "Error creating output file " << output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	ostream& out = to_stdout ? cout : outfile;
+
+	Basic_Rack_Plan<Planner> plan;
+	if (online) {
+		ifstream infile;
+		if (input_name != "-") {
+			infile.open(input_name);
+			if (infile.fail()) {
+				cerr << "Error reading " << input_name << ": could not open the file" << endl;
+				return EXIT_INPUT_ERROR;
+			}
+		}
+		bool header_written = false;
+		plan = plan_racks_online<Planner>(input_name == "-" ? cin : infile, options, [&](Planner& program, int first) {
+			if (!header_written) {
+				program.write_results_header(out);
+				header_written = true;
+			}
+			program.write_result_rows(out, first);
+		});
+	}
+	else if (!delta_name.empty()) {
+		ifstream planfile;
+		if (input_name != "-") {
+			planfile.open(input_name);
+			if (planfile.fail()) {
+				cerr << "Error reading " << input_name << ": could not open the file" << endl;
+				return EXIT_INPUT_ERROR;
+			}
+		}
+		ifstream deltafile(delta_name);
+		if (deltafile.fail()) {
+			cerr << "Error reading " << delta_name << ": could not open the file" << endl;
+			return EXIT_INPUT_ERROR;
+		}
+		plan = replan_racks<Planner>(input_name == "-" ? cin : planfile, deltafile, options);
+	}
+	else if (input_name == "-") {
+		plan = plan_racks<Planner>(cin, options);
+	}
+	else {
+		plan = plan_rack_file<Planner>(input_name, options);
+	}
+	if (!plan.ok) {
+		cerr << "Error reading " << (delta_name.empty() ? input_name : input_name + " with " + delta_name) << ": " << plan.error << endl;
+		return EXIT_INPUT_ERROR;
+	}
+
+	if (summary) {
+		//keep stdout clean for the csv when that is where it goes
+		plan.program.write_summary(to_stdout ? cerr : cout);
+	}
+	if (!server.socket_path.empty()) {
+		if (!serve_plans(plan.program, options, server, cerr, error)) {
+			cerr << "Error serving on " << server.socket_path << ": " << error << endl;
+			return EXIT_SERVER_ERROR;
+		}
+		return EXIT_SUCCESS;
+	}
+	if (!plan_output_name.empty()) {
+		ofstream planfile(plan_output_name, ios::binary);
+		if (planfile.fail()) {
+			cerr << "Error creating plan file " << plan_output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+		plan.program.write_plan_file(planfile);
+		planfile.close();
+		if (planfile.fail()) {
+			cerr << "Error writing plan file " << plan_output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	if (!bound_output_name.empty()) {
+		ofstream boundfile(bound_output_name);
+		if (boundfile.fail()) {
+			cerr << "Error creating bound file " << bound_output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+		plan.program.write_bound(boundfile);
+		boundfile.close();
+		if (boundfile.fail()) {
+			cerr << "Error writing bound file " << bound_output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	if (online) {
+		//the rows are already out, only the blank line write_results ends with is left
+		out << endl;
+		if (!to_stdout) {
+			outfile.close();
+		}
+		if (out.fail()) {
+			cerr << "Error writing output file " << output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	else if (to_stdout) {
+		plan.program.write_results(cout);
+		if (cout.fail()) {
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	else {
+		outfile.open(output_name);
+		if (outfile.fail()) {
+			cerr << "Error creating output file " << output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+		plan.program.write_results(outfile);
+		outfile.close();
+		if (outfile.fail()) {
+			cerr << "Error writing output file " << output_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+	if (!options.inventory_path.empty()) {
+		//the held racks replace the inventory that was read in, only once the plan that leaves them out is written
+		ofstream inventory(options.inventory_path);
+		plan.program.write_inventory(inventory);
+		inventory.close();
+		if (inventory.fail()) {
+			cerr << "Error writing inventory file " << options.inventory_path << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+#ifdef RACK_INSTRUMENTATION
+	if (stats_name == "-") {
+		plan.program.write_stats(cerr);
+	}
+	else if (!stats_name.empty()) {
+		ofstream statsfile(stats_name);
+		plan.program.write_stats(statsfile);
+		statsfile.close();
+		if (statsfile.fail()) {
+			cerr << "Error writing stats file " << stats_name << endl;
+			return EXIT_OUTPUT_ERROR;
+		}
+	}
+#endif
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+	//pass --exact (or --mode exact) to build batches with the exact solver instead of the ratio heuristic, and --portfolio <passes>
+	//to keep the best of many varied passes (optionally with --threads <count> and --seed <seed>). --improve <seconds> runs the
+	//local search over the finished batches afterwards. --input/--output skip the prompts, see print_usage
+	Plan_Options options;
+	options.num_threads = max(1, (int)thread::hardware_concurrency());
+	string input_name;
+	string output_name;
+	string plan_output_name;
+	string bound_output_name;
+	bool summary = false;
+	string bench_file;
+	string stats_name;
+	bool online = false;
+	string delta_name;
+	Server_Options server;
+	string client_socket;
+	string request_name;
+	try {
+		for (int i = 1; i < argc; i++) {
+			string arg = argv[i];
+			bool has_value = i + 1 < argc;
+			if (arg == "--exact") {
+				options.exact_mode = true;
+			}
+			else if (arg == "--mode" && has_value) {
+				string mode = argv[++i];
+				if (mode != "heuristic" && mode != "exact") {
+					throw invalid_argument(mode);
+				}
+				options.exact_mode = mode == "exact";
+			}
+			else if (arg == "--portfolio" && has_value) {
+				options.portfolio_passes = stoi(argv[++i]);
+			}
+			else if (arg == "--threads" && has_value) {
+				options.num_threads = stoi(argv[++i]);
+			}
+			else if (arg == "--rack-capacity" && has_value) {
+				options.rack_capacity = stoi(argv[++i]);
+			}
+			else if (arg == "--batch-capacity" && has_value) {
+				options.batch_capacity = stoi(argv[++i]);
+			}
+			else if (arg == "--destinations" && has_value) {
+				//comma separated formats, each <spots> or <spots>:<limit per batch>
+				options.destination_formats.clear();
+				stringstream list(argv[++i]);
+				string item;
+				while (getline(list, item, ',')) {
+					size_t colon = item.find(':');
+					int capacity = stoi(item.substr(0, colon));
+					int limit = colon == string::npos ? INT_MAX : stoi(item.substr(colon + 1));
+					options.destination_formats.push_back({ capacity, limit });
+				}
+			}
+			else if (arg == "--online" && has_value) {
+				online = true;
+				options.online_fill = stod(argv[++i]);
+				if (options.online_fill < 0 || options.online_fill > 1) {
+					throw invalid_argument(arg);
+				}
+			}
+			else if (arg == "--online-chunk" && has_value) {
+				options.online_chunk = stoi(argv[++i]);
+				if (options.online_chunk < 1) {
+					throw invalid_argument(arg);
+				}
+			}
+			else if (arg == "--carry-over" && has_value) {
+				options.inventory_path = argv[++i];
+			}
+			else if (arg == "--hold-fill" && has_value) {
+				options.hold_fill = stod(argv[++i]);
+				if (options.hold_fill < 0 || options.hold_fill > 1) {
+					throw invalid_argument(arg);
+				}
+			}
+			else if (arg == "--max-hold" && has_value) {
+				options.max_hold = stoi(argv[++i]);
+				if (options.max_hold < 0) {
+					throw invalid_argument(arg);
+				}
+			}
+			else if (arg == "--delta" && has_value) {
+				delta_name = argv[++i];
+			}
+			else if (arg == "--serve" && has_value) {
+				server.socket_path = argv[++i];
+			}
+			else if (arg == "--group-window" && has_value) {
+				server.group_window_ms = stoi(argv[++i]);
+				if (server.group_window_ms < 0) {
+					throw invalid_argument(arg);
+				}
+			}
+			else if (arg == "--client" && has_value) {
+				client_socket = argv[++i];
+			}
+			else if (arg == "--request" && has_value) {
+				request_name = argv[++i];
+				if (request_name != "PLAN" && request_name != "WHATIF" && request_name != "DELTA" && request_name != "STOP") {
+					throw invalid_argument(request_name);
+				}
+			}
+			else if (arg == "--seed" && has_value) {
+				options.seed = stoul(argv[++i]);
+			}
+			else if (arg == "--improve" && has_value) {
+				options.improve_seconds = stod(argv[++i]);
+			}
+			else if (arg == "--input" && has_value) {
+				input_name = argv[++i];
+			}
+			else if (arg == "--output" && has_value) {
+				output_name = argv[++i];
+			}
+			else if (arg == "--plan-output" && has_value) {
+				plan_output_name = argv[++i];
+			}
+			else if (arg == "--bound-output" && has_value) {
+				bound_output_name = argv[++i];
+			}
+			else if (arg == "--summary") {
+				summary = true;
+			}
+			else if (arg == "--bench-parse" && has_value) {
+				bench_file = argv[++i];
+			}
+#ifdef RACK_INSTRUMENTATION
+			else if (arg == "--stats" && has_value) {
+				stats_name = argv[++i];
+			}
+#endif
+			else if (arg == "--help") {
+				print_usage(cout);
+				return EXIT_SUCCESS;
+			}
+			else {
+				throw invalid_argument(arg);
+			}
+		}
+	}
+	catch (const exception&) {
+		print_usage(cerr);
+		return EXIT_USAGE;
+	}
 
-	//execute algorithm
-	my_program.distribute_racks();
+	if (!bench_file.empty()) {
+		return bench_parse(bench_file, options.num_threads);
+	}
+	if (!client_socket.empty() || !request_name.empty()) {
+		if (client_socket.empty() || request_name.empty() || !server.socket_path.empty()) {
+			cerr << "--client needs --request and can't be used with --serve" << endl;
+			print_usage(cerr);
+			return EXIT_USAGE;
+		}
+		return run_client(client_socket, request_name, input_name, output_name, summary);
+	}
+	if (!server.socket_path.empty() && (input_name.empty() || online || !options.inventory_path.empty())) {
+		//the served plan takes deltas, so it must stay whole: no batches already out and none held back
+		cerr << "--serve needs --input and can't be used with --online or --carry-over" << endl;
+		print_usage(cerr);
+		return EXIT_USAGE;
+	}
+	if (online && input_name.empty()) {
+		//the prompts read a whole file before planning, so online intake needs --input
+		cerr << "--online needs --input" << endl;
+		print_usage(cerr);
+		return EXIT_USAGE;
+	}
+	if (!options.inventory_path.empty() && (online || input_name.empty())) {
+		//online batches are out before it is known which would be held, and the prompts don't read an inventory
+		cerr << "--carry-over needs --input and can't be used with --online" << endl;
+		print_usage(cerr);
+		return EXIT_USAGE;
+	}
+	if (!delta_name.empty() && (input_name.empty() || online || !options.inventory_path.empty() || options.portfolio_passes > 0
+		|| options.improve_seconds > 0)) {
+		//a repair keeps every batch the delta doesn't touch, which a new plan, portfolio passes or the local search would not
+		cerr << "--delta needs --input and can't be used with --online, --carry-over, --portfolio or --improve" << endl;
+		print_usage(cerr);
+		return EXIT_USAGE;
+	}
 
-	//display results
-	my_program.print_summary();
-	my_program.export_results();
+	int exit_code = EXIT_SUCCESS;
+	bool format_built = visit_format(options.rack_capacity, options.batch_capacity, [&](auto format) {
+		exit_code = plan_and_write<typename decltype(format)::type>(options, input_name, output_name, plan_output_name, bound_output_name, summary, stats_name, online, delta_name, server);
+	});
+	if (!format_built) {
+		cerr << "no planner is built for " << options.rack_capacity << "-spot racks in batches of " << options.batch_capacity << endl;
+		print_usage(cerr);
+		return EXIT_USAGE;
+	}
+	return exit_code;
 }
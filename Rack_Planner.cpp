@@ -0,0 +1,200 @@
+/*
+Rack_Planner.cpp
+Headless entry point for the rack algorithm. See Rack_Planner.h header comment for more information.
+*/
+
+#include <iostream>
+#include "Rack_Planner.h"
+
+using namespace std;
+
+/*
+* name: run_plan
+* purpose: runs the algorithm on the racks a Program has read in
+* arguments: the Program, the options to plan with, and a string that is set to a description of the problem if the options are bad
+* returns: true if the plan was made, false if the destination formats can't be used
+* notes: the Program must not have been planned yet. with an inventory_path, the under-filled batches are held back last
+*/
+template <class Planner>
+bool run_plan(Planner& program, const Plan_Options& options, string& error) {
+    if (!program.set_destination_formats(options.destination_formats, error)) {
+        return false;
+    }
+    program.set_exact_mode(options.exact_mode);
+    program.populate_frequencies();
+
+    if (options.portfolio_passes > 0) {
+        program.distribute_portfolio(options.portfolio_passes, options.num_threads, options.seed);
+    }
+    else {
+        program.distribute_racks();
+    }
+    if (options.improve_seconds > 0) {
+        program.improve_batches(options.improve_seconds);
+    }
+    if (!options.inventory_path.empty()) {
+        program.hold_underfilled(options.hold_fill, options.max_hold);
+    }
+    return true;
+}
+
+/*
+* name: plan_racks
+* purpose: reads rack data from a stream and plans it
+* arguments: the stream holding the rack data and the options to plan with
+* returns: the finished plan, or ok = false and the reason if the data could not be read or the options are bad
+* notes: nothing is printed and nothing is prompted for
+*/
+template <class Planner>
+Basic_Rack_Plan<Planner> plan_racks(istream& input, const Plan_Options& options) {
+    Basic_Rack_Plan<Planner> plan;
+    plan.program.set_read_threads(options.num_threads);
+    if (!options.inventory_path.empty() && !plan.program.read_inventory(options.inventory_path, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    if (!plan.program.read_stream(input, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    if (!run_plan(plan.program, options, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    plan.ok = true;
+    return plan;
+}
+
+/*
+* name: plan_racks
+* purpose: plans rack data that is already in memory
+* arguments: the rack data, its size in bytes, and the options to plan with
+* returns: the finished plan, or ok = false and the reason if the data could not be read or the options are bad
+* notes: the buffer is parsed in place, not copied, on up to options.num_threads threads
+*/
+template <class Planner>
+Basic_Rack_Plan<Planner> plan_racks(const char* data, size_t size, const Plan_Options& options) {
+    Basic_Rack_Plan<Planner> plan;
+    plan.program.set_read_threads(options.num_threads);
+    if (!options.inventory_path.empty() && !plan.program.read_inventory(options.inventory_path, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    if (!plan.program.read_buffer(data, size, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    if (!run_plan(plan.program, options, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    plan.ok = true;
+    return plan;
+}
+
+/*
+* name: plan_rack_file
+* purpose: plans the rack data in a file
+* arguments: the path of the file and the options to plan with
+* returns: the finished plan, or ok = false and the reason if the file could not be opened or read or the options are bad
+* notes: the file is memory mapped and parsed in place on up to options.num_threads threads
+*/
+template <class Planner>
+Basic_Rack_Plan<Planner> plan_rack_file(const string& path, const Plan_Options& options) {
+    Basic_Rack_Plan<Planner> plan;
+    plan.program.set_read_threads(options.num_threads);
+    if (!options.inventory_path.empty() && !plan.program.read_inventory(options.inventory_path, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    if (!plan.program.read_file(path, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    if (!run_plan(plan.program, options, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    plan.ok = true;
+    return plan;
+}
+
+/*
+* name: plan_racks_online
+* purpose: reads rack data from a stream as it arrives and plans it, handing out batches before the stream has ended
+* arguments: the stream holding the rack data, the options to plan with, and the function to call with each group of new batches
+* returns: the finished plan, or ok = false and the reason if a line could not be read or the options are bad
+* notes: batches already handed to on_batches stay in the plan when a later line turns out to be bad, only the returned plan is
+*        emptied. see Online.cpp
+*/
+template <class Planner>
+Basic_Rack_Plan<Planner> plan_racks_online(istream& input, const Plan_Options& options, const function<void(Planner&, int)>& on_batches) {
+    Basic_Rack_Plan<Planner> plan;
+    if (!plan.program.set_destination_formats(options.destination_formats, plan.error)) {
+        return plan;
+    }
+    plan.program.set_exact_mode(options.exact_mode);
+    plan.program.set_online_fill(options.online_fill);
+
+    string line;
+    int line_number = 0;
+    int racks_since_emit = 0;
+    while (getline(input, line)) {
+        line_number++;
+        if (!plan.program.add_rack_line(line, plan.error)) {
+            plan.error = "line " + to_string(line_number) + ": " + plan.error;
+            plan.program = Planner();
+            return plan;
+        }
+        if (++racks_since_emit >= options.online_chunk) {
+            racks_since_emit = 0;
+            int first = plan.program.get_num_batches();
+            if (plan.program.emit_ready_batches() > 0) {
+                on_batches(plan.program, first);
+            }
+        }
+    }
+
+    int first = plan.program.get_num_batches();
+    plan.program.flush_online();
+    on_batches(plan.program, first);
+    plan.ok = true;
+    return plan;
+}
+
+/*
+* name: replan_racks
+* purpose: loads a plan written earlier and repairs it after racks are added or removed
+* arguments: the stream holding the results csv of the plan, the stream holding the delta, and the options to plan with
+* returns: the repaired plan, or ok = false and the reason if the plan or the delta could not be read or the options are bad
+* notes: only the destination formats and exact mode of the options are used, exact mode for the racks that need new batches.
+*        see Replan.cpp
+*/
+template <class Planner>
+Basic_Rack_Plan<Planner> replan_racks(istream& plan_input, istream& delta, const Plan_Options& options) {
+    Basic_Rack_Plan<Planner> plan;
+    if (!plan.program.set_destination_formats(options.destination_formats, plan.error)) {
+        return plan;
+    }
+    plan.program.set_exact_mode(options.exact_mode);
+    if (!plan.program.read_plan(plan_input, plan.error) || !plan.program.apply_delta(delta, plan.error)) {
+        plan.program = Planner();
+        return plan;
+    }
+    plan.ok = true;
+    return plan;
+}
+
+#define INSTANTIATE_RACK_PLANNER(RACK_CAPACITY, BATCH_CAPACITY) \
+    template bool run_plan(Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>& program, const Plan_Options& options, string& error); \
+    template Basic_Rack_Plan<Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>> \
+        plan_racks(istream& input, const Plan_Options& options); \
+    template Basic_Rack_Plan<Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>> \
+        plan_racks(const char* data, size_t size, const Plan_Options& options); \
+    template Basic_Rack_Plan<Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>> \
+        plan_rack_file(const string& path, const Plan_Options& options); \
+    template Basic_Rack_Plan<Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>> plan_racks_online(istream& input, \
+        const Plan_Options& options, const function<void(Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>&, int)>& on_batches); \
+    template Basic_Rack_Plan<Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>> \
+        replan_racks(istream& plan_input, istream& delta, const Plan_Options& options);
+RACK_FORMATS(INSTANTIATE_RACK_PLANNER)
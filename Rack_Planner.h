@@ -0,0 +1,104 @@
+/*
+Rack_Planner.h: headless entry point for the rack algorithm.
+
+plan_racks runs the whole pipeline (read, populate frequencies, distribute, optionally improve) on rack data that is already in
+memory or in a stream, without prompting or touching the inputs/ and results/ folders. The finished plan is returned as a Program,
+so callers can walk get_batches() directly or write it out with write_results/write_summary. plan_racks_online instead hands
+batches to the caller while the stream is still being read, and replan_racks repairs a plan written earlier after racks are added
+or removed.
+
+Every function is a template on the planner, Program unless another Basic_Program format is asked for. visit_format turns a rack
+and batch capacity chosen at run time into one of the formats in RACK_FORMATS.
+
+*/
+
+#ifndef RACK_PLANNER_H
+#define RACK_PLANNER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include "Program.h"
+
+using namespace std;
+
+//how to build the plan, matching the command line flags of Rack_Final
+struct Plan_Options {
+	//build batches with the exact solver instead of the ratio heuristic
+	bool exact_mode = false;
+	//when above 0, keep the best of this many portfolio passes
+	int portfolio_passes = 0;
+	//threads to parse the input and run portfolio passes on
+	int num_threads = 1;
+	//seed for the randomized portfolio passes
+	unsigned seed = 1;
+	//when above 0, run the local search over the finished batches for this many seconds
+	double improve_seconds = 0;
+	//plate format: spots in a rack and total racks in a batch, must be one of RACK_FORMATS (see visit_format)
+	int rack_capacity = DEFAULT_RACK_CAPACITY;
+	int batch_capacity = DEFAULT_BATCH_CAPACITY;
+	//destination racks batches may fill, with how many of each one batch may use. empty for rack_capacity racks only
+	vector<Destination_Format> destination_formats;
+	//plan_racks_online only: fraction (0 to 1) of its destination spots a batch must fill to be taken out before the input ends,
+	//and how many lines of input are read between attempts to take batches out
+	double online_fill = 0.95;
+	int online_chunk = 1;
+	//carry-over, see Carry_Over.cpp: when inventory_path is set, the racks held there are read ahead of the input, and batches
+	//whose sources and destinations take up less than hold_fill (0 to 1) of the batch_capacity rack positions are held back,
+	//unless one of their racks has already been held max_hold runs. the caller saves the held racks with write_inventory. not used by plan_racks_online
+	string inventory_path;
+	double hold_fill = 0.8;
+	int max_hold = 2;
+};
+
+//result of plan_racks. when ok is false, error describes the bad input and program holds no batches
+template <class Planner = Program>
+struct Basic_Rack_Plan {
+	bool ok = false;
+	string error;
+	Planner program;
+};
+using Rack_Plan = Basic_Rack_Plan<Program>;
+
+//run the algorithm on a Program that already holds the racks read in. returns false and sets error if the options can't be used
+template <class Planner>
+bool run_plan(Planner& program, const Plan_Options& options, string& error);
+
+//read rack data (same format as the files in inputs/) from a stream, a buffer or a file and plan it
+template <class Planner = Program>
+Basic_Rack_Plan<Planner> plan_racks(istream& input, const Plan_Options& options);
+template <class Planner = Program>
+Basic_Rack_Plan<Planner> plan_racks(const char* data, size_t size, const Plan_Options& options);
+template <class Planner = Program>
+Basic_Rack_Plan<Planner> plan_rack_file(const string& path, const Plan_Options& options);
+
+//read rack data from a stream one line at a time, taking each batch out as soon as it can be made filling options.online_fill of its
+//destination spots, then plan the rest once the stream ends. on_batches(program, first) is called each time batches from index
+//first to the end of program.get_batches() have just been made, the last time after the stream ends. portfolio passes and the
+//local search are not run, since they would change batches that are already out
+template <class Planner = Program>
+Basic_Rack_Plan<Planner> plan_racks_online(istream& input, const Plan_Options& options, const function<void(Planner&, int)>& on_batches);
+
+//load a results csv written earlier from plan_input and apply the delta of added and removed racks in delta to it, changing only
+//the batches the delta touches (see Replan.cpp). options must have the destination formats the plan was made for. portfolio passes,
+//the local search and the carry-over are not run, since they would change batches the delta doesn't touch
+template <class Planner = Program>
+Basic_Rack_Plan<Planner> replan_racks(istream& plan_input, istream& delta, const Plan_Options& options);
+
+//calls use(type_identity<Basic_Program<rack_capacity, batch_capacity>>()) for the matching format in RACK_FORMATS, so the caller
+//can run the planner built for it. returns false, without calling use, if that format isn't built
+template <class Use>
+bool visit_format(int rack_capacity, int batch_capacity, Use&& use) {
+#define RACK_VISIT_FORMAT(RACK_CAPACITY, BATCH_CAPACITY) \
+	if (rack_capacity == RACK_CAPACITY && batch_capacity == BATCH_CAPACITY) { \
+		use(type_identity<Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>>()); \
+		return true; \
+	}
+	RACK_FORMATS(RACK_VISIT_FORMAT)
+#undef RACK_VISIT_FORMAT
+	return false;
+}
+
+#endif
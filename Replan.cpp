@@ -0,0 +1,586 @@
+/*
+Replan.cpp
+Incremental re-planning for the Program class. A results csv written earlier is loaded back into finished_batches, and a delta of
+racks added and removed by id is applied to it, changing only the batches the delta touches instead of planning every rack again.
+See Program.h header comment for more information on the Program class.
+
+The delta is one rack per line, + for a rack to add (with its sample number, as in an input file) and - for a rack to take out:
+
+    + SAMPLEid7 23
+    - SAMPLEid3
+
+A removed rack leaves its batch, which stays valid since it only gets smaller. An added rack goes, largest first, into the batch
+whose destination racks have the fewest empty spots that still hold it, then into a batch with room for one more destination
+rack, and only the racks that fit nowhere are planned into new batches. Batches are kept in slack_buckets by their empty spots,
+so finding one costs the same whatever the size of the plan.
+*/
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <system_error>
+#include "Program.h"
+
+using namespace std;
+
+/*
+* name: read_plan
+* purpose: loads the batches of a results csv written by write_results as the finished batches, ready for apply_delta
+* arguments: the stream holding the csv, and a string that is set to a description of the problem if the csv is bad
+* returns: true if the plan was read, false if a row is malformed
+* notes: the Program must not hold any racks yet, and set_destination_formats must already have been called with the formats the
+*        plan was made for. batches keep the order of their first rows and are numbered from 1 in that order. only the rack id,
+*        sample count and batch id columns are read. a batch with more racks than fit is kept as it is, but nothing is added to it.
+*        the planner takes an id that is in its input more than once as that many racks, so a plan can list one twice. such a plan
+*        is read as it is and indexed the way index_plan describes
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_plan(istream& in, string& error) {
+    if (!racks.empty()) {
+        error = "a plan can only be read into a program that holds no racks";
+        return false;
+    }
+    unordered_map<int, int> batch_index;
+    //rows of one batch are together, so the batch of the row before is checked first
+    int last_batch_id = 0;
+    int last_batch = -1;
+    string line;
+    int line_number = 0;
+    bool header_read = false;
+    while (getline(in, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (!header_read) {
+            if (line.rfind("Rack ID,", 0) != 0) {
+                error = "line " + to_string(line_number) + ": expected the header row of a results csv";
+                return false;
+            }
+            header_read = true;
+            continue;
+        }
+
+        //rack id, sample count and batch id are the first three columns
+        size_t first_comma = line.find(',');
+        size_t second_comma = first_comma == string::npos ? string::npos : line.find(',', first_comma + 1);
+        size_t third_comma = second_comma == string::npos ? string::npos : line.find(',', second_comma + 1);
+        if (first_comma == 0 || second_comma == string::npos) {
+            error = "line " + to_string(line_number) + ": expected a rack id, sample count and batch id";
+            return false;
+        }
+        if (third_comma == string::npos) {
+            third_comma = line.size();
+        }
+        int num_samples = 0;
+        int batch_id = 0;
+        const char* samples_end = line.data() + second_comma;
+        const char* batch_end = line.data() + third_comma;
+        if (from_chars(line.data() + first_comma + 1, samples_end, num_samples).ptr != samples_end
+            || from_chars(line.data() + second_comma + 1, batch_end, batch_id).ptr != batch_end) {
+            error = "line " + to_string(line_number) + ": expected a rack id, sample count and batch id";
+            return false;
+        }
+        if (num_samples < 1 || num_samples > RACK_CAPACITY) {
+            error = "line " + to_string(line_number) + ": sample number " + to_string(num_samples) + " is not between 1 and " + to_string(RACK_CAPACITY);
+            return false;
+        }
+
+        if (!racks.add(string_view(line.data(), first_comma), num_samples)) {
+            error = "rack ids take up more than 4 GB";
+            return false;
+        }
+        if (last_batch == -1 || batch_id != last_batch_id) {
+            auto [found, added] = batch_index.emplace(batch_id, finished_batches.size());
+            if (added) {
+                finished_batches.push_back(Batch{ (int)finished_batches.size() + 1, {} });
+            }
+            last_batch_id = batch_id;
+            last_batch = found->second;
+        }
+        finished_batches[last_batch].batch_sources.push_back(racks.size() - 1);
+    }
+    if (!header_read) {
+        error = "the plan is empty";
+        return false;
+    }
+
+    index_plan();
+    return true;
+}
+
+/*
+* name: index_plan
+* purpose: sets up the finished batches, however they were made, for apply_delta: the id index, the batch of every rack, the
+*          histogram of the racks in batches and slack_buckets
+* arguments: none
+* returns: the index of a rack whose id is in the plan more than once, -1 if every id is unique
+* notes: read_plan calls it, and apply_delta calls it for a plan that hasn't been indexed yet. racks that are in no batch are left out.
+*        the lower bound is recomputed over the racks in batches. a repeated id is still indexed, and a delta removes the first
+*        rack read with it, one per delta
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::index_plan() {
+    rack_by_id = Rack_Index<RACK_CAPACITY>();
+    rack_batch.assign(racks.size(), -1);
+    plan_frequencies = {};
+    for (int slack = 0; slack <= RACK_CAPACITY; slack++) {
+        slack_buckets[slack].clear();
+    }
+    roomy_batches.clear();
+    batch_delta.assign(finished_batches.size(), 0);
+
+    int num_planned = 0;
+    for (int b = 0; b < finished_batches.size(); b++) {
+        for (int rack : finished_batches[b].batch_sources) {
+            rack_batch[rack] = b;
+            plan_frequencies[racks.samples(rack)]++;
+        }
+        num_planned += finished_batches[b].batch_sources.size();
+        index_batch(b);
+    }
+
+    //ids are indexed in read order, which walks the id arena front to back
+    auto is_live = [&](int rack) { return rack_batch[rack] != -1; };
+    int repeated = -1;
+    rack_by_id.reserve(num_planned);
+    for (int rack = 0; rack < racks.size(); rack++) {
+        if (rack_batch[rack] == -1) {
+            continue;
+        }
+        if (repeated == -1 && rack_by_id.find(racks, racks.id(rack), is_live) != -1) {
+            repeated = rack;
+        }
+        rack_by_id.insert(racks, rack);
+    }
+    batch_lower_bound = compute_lower_bound(plan_frequencies);
+    return repeated;
+}
+
+/*
+* name: apply_delta
+* purpose: adds and removes racks of a finished plan, repairing only the batches they are in or go into
+* arguments: the stream holding the delta, and a string that is set to a description of the problem if the delta is bad
+* returns: true if the delta was applied, false (with the plan unchanged) if a line is malformed, a removed rack is not in the
+*          plan, an added one already is or the added ids would outgrow the id arena
+* notes: removals come first, so a rack can be taken out and added back with a new sample number in one delta. a batch left empty
+*        is replaced by the last batch, so only that one is renumbered. racks that fit in no batch are planned with distribute_racks
+*        into new batches at the end. may be called any number of times, on a plan from read_plan or any finished plan, and
+*        compact_racks keeps the racks it removes from piling up. see get_num_changed
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::apply_delta(istream& in, string& error) {
+    //one rack of the delta, num_samples is 0 for a removal
+    struct Delta_Rack {
+        string id;
+        int num_samples;
+        int line_number;
+    };
+    vector<Delta_Rack> removals;
+    vector<Delta_Rack> additions;
+    auto is_blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+
+    string line;
+    int line_number = 0;
+    while (getline(in, line)) {
+        line_number++;
+        const char* p = line.data();
+        const char* end = p + line.size();
+        while (p < end && is_blank(*p)) {
+            p++;
+        }
+        if (p == end) {
+            continue;
+        }
+        char sign = *p++;
+        string_view id;
+        int num_samples = 0;
+        if (sign == '+') {
+            if (!parse_rack_line(p, end, RACK_CAPACITY, id, num_samples, error)) {
+                error = "delta line " + to_string(line_number) + ": " + error;
+                return false;
+            }
+        }
+        else if (sign == '-') {
+            //only the id is needed, a sample number after it is ignored
+            while (p < end && is_blank(*p)) {
+                p++;
+            }
+            const char* id_begin = p;
+            while (p < end && !is_blank(*p)) {
+                p++;
+            }
+            id = string_view(id_begin, p - id_begin);
+        }
+        if ((sign != '+' && sign != '-') || id.empty()) {
+            error = "delta line " + to_string(line_number) + ": expected + or - followed by a rack id";
+            return false;
+        }
+        (sign == '+' ? additions : removals).push_back({ string(id), num_samples, line_number });
+    }
+
+    //check the whole delta before changing anything
+    if (rack_batch.size() != racks.size()) {
+        index_plan();
+    }
+    auto is_live = [&](int rack) { return rack_batch[rack] != -1; };
+    unordered_set<string_view> removed;
+    for (const Delta_Rack& rack : removals) {
+        if (rack_by_id.find(racks, rack.id, is_live) == -1 || !removed.insert(rack.id).second) {
+            error = "delta line " + to_string(rack.line_number) + ": rack " + rack.id + " is not in the plan";
+            return false;
+        }
+    }
+    unordered_set<string_view> added;
+    for (const Delta_Rack& rack : additions) {
+        if ((rack_by_id.find(racks, rack.id, is_live) != -1 && removed.count(rack.id) == 0) || !added.insert(rack.id).second) {
+            error = "delta line " + to_string(rack.line_number) + ": rack " + rack.id + " is already in the plan";
+            return false;
+        }
+    }
+    size_t added_id_size = 0;
+    for (const Delta_Rack& rack : additions) {
+        added_id_size += rack.id.size();
+    }
+    if (racks.id_arena.size() + added_id_size > UINT32_MAX) {
+        error = "rack ids take up more than 4 GB";
+        return false;
+    }
+
+    num_deltas++;
+    num_changed = 0;
+    for (const Delta_Rack& rack : removals) {
+        int source = rack_by_id.find(racks, rack.id, is_live);
+        int b = rack_batch[source];
+        rack_batch[source] = -1;
+        plan_frequencies[racks.samples(source)]--;
+
+        save_for_trial(b);
+        vector<int>& sources = finished_batches[b].batch_sources;
+        sources.erase(find(sources.begin(), sources.end(), source));
+        mark_changed(b);
+        if (!sources.empty()) {
+            index_batch(b);
+            continue;
+        }
+
+        //the last batch takes the place of the empty one
+        int last = finished_batches.size() - 1;
+        save_for_trial(last);
+        if (b != last) {
+            finished_batches[b] = move(finished_batches[last]);
+            finished_batches[b].batch_num = b + 1;
+            for (int rack_index : finished_batches[b].batch_sources) {
+                rack_batch[rack_index] = b;
+            }
+            batch_delta[b] = batch_delta[last];
+            mark_changed(b);
+            index_batch(b);
+        }
+        finished_batches.pop_back();
+        batch_delta.pop_back();
+    }
+
+    //largest first, so the small racks fill the spots the large ones leave
+    stable_sort(additions.begin(), additions.end(), [](const Delta_Rack& a, const Delta_Rack& b) { return a.num_samples > b.num_samples; });
+    for (const Delta_Rack& rack : additions) {
+        //can't fail, the arena was checked to have room for every added id
+        racks.add(rack.id, rack.num_samples);
+        int source = racks.size() - 1;
+        rack_by_id.insert(racks, source);
+        rack_batch.push_back(-1);
+        plan_frequencies[rack.num_samples]++;
+
+        int b = find_batch_for(rack.num_samples);
+        if (b == -1) {
+            //planned into a new batch below
+            source_buckets[rack.num_samples].push_back(source);
+            sources_remaining++;
+            increment_frequency(rack.num_samples);
+            continue;
+        }
+        save_for_trial(b);
+        finished_batches[b].batch_sources.push_back(source);
+        rack_batch[source] = b;
+        mark_changed(b);
+        index_batch(b);
+    }
+
+    if (sources_remaining > 0) {
+        int first_new = finished_batches.size();
+        distribute_racks();
+        for (int b = first_new; b < finished_batches.size(); b++) {
+            for (int rack_index : finished_batches[b].batch_sources) {
+                rack_batch[rack_index] = b;
+            }
+            batch_delta.push_back(0);
+            mark_changed(b);
+            index_batch(b);
+        }
+    }
+    batch_lower_bound = compute_lower_bound(plan_frequencies);
+    compact_racks();
+    return true;
+}
+
+/*
+* name: compact_racks
+* purpose: drops the racks deltas have removed from the Rack_Store and the id index once they are more than half of it
+* arguments: none
+* returns: none
+* notes: a removed rack stays in the store and the index until then, and a re-added id takes a new slot, so a plan that keeps
+*        taking deltas would otherwise grow without limit. the racks left keep their read order, so a repeated id still removes the
+*        first rack read with it. nothing is done during a trial, whose racks end_trial cuts by position, or while racks are waiting
+*        to be planned or held for the carry-over inventory, which are in no batch but not removed. costs one pass over the racks,
+*        at most once per as many removals as there are racks left
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::compact_racks() {
+    if (trial.open || sources_remaining > 0 || !held_racks.empty() || !runs_held.empty()) {
+        return;
+    }
+    int num_live = 0;
+    size_t live_id_size = 0;
+    for (int rack = 0; rack < racks.size(); rack++) {
+        if (rack_batch[rack] != -1) {
+            num_live++;
+            live_id_size += racks.id(rack).size();
+        }
+    }
+    if (racks.size() - num_live <= num_live) {
+        return;
+    }
+
+    //new index of every live rack, in read order
+    Racks live;
+    live.reserve(num_live, live_id_size);
+    vector<int> new_index(racks.size(), -1);
+    for (int rack = 0; rack < racks.size(); rack++) {
+        if (rack_batch[rack] != -1) {
+            new_index[rack] = live.size();
+            //can't fail, the live ids are a part of an arena that already fit
+            live.add(racks.id(rack), racks.samples(rack));
+        }
+    }
+    for (Batch& batch : finished_batches) {
+        for (int& rack : batch.batch_sources) {
+            rack = new_index[rack];
+        }
+    }
+    vector<int> live_batch(num_live);
+    for (int rack = 0; rack < racks.size(); rack++) {
+        if (new_index[rack] != -1) {
+            live_batch[new_index[rack]] = rack_batch[rack];
+        }
+    }
+    racks = move(live);
+    rack_batch = move(live_batch);
+
+    rack_by_id = Rack_Index<RACK_CAPACITY>();
+    rack_by_id.reserve(num_live);
+    for (int rack = 0; rack < racks.size(); rack++) {
+        rack_by_id.insert(racks, rack);
+    }
+}
+
+/*
+* name: fits_batch
+* purpose: checks whether a batch with the given sources and sample total fits in BATCH_CAPACITY racks
+* arguments: the number of source racks and their sample total
+* returns: true if the sources and the destination racks they need fit in one batch
+* notes: none
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::fits_batch(int num_sources, int total) {
+    return batch_spots(total) > 0 && num_sources + destinations_for(total) <= BATCH_CAPACITY;
+}
+
+/*
+* name: index_batch
+* purpose: files a finished batch under its current empty destination spots in slack_buckets, and in roomy_batches if it has room
+*          for another source and another destination rack
+* arguments: the index of the batch in finished_batches
+* returns: none
+* notes: older entries for the batch are left where they are and skipped by find_batch_for once they no longer match
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::index_batch(int batch) {
+    int total = batch_total(finished_batches[batch]);
+    int free_racks = BATCH_CAPACITY - (int)finished_batches[batch].batch_sources.size() - destinations_for(total);
+    if (free_racks >= 1) {
+        slack_buckets[min(batch_spots(total) - total, RACK_CAPACITY)].push_back(batch);
+    }
+    if (free_racks >= 2) {
+        roomy_batches.push_back(batch);
+    }
+}
+
+/*
+* name: find_batch_for
+* purpose: finds the finished batch a rack with the given sample number should join
+* arguments: the sample number
+* returns: the index in finished_batches of the batch, or -1 if the rack fits in none
+* notes: the batch with the fewest empty destination spots that still hold the rack, or failing that the most recently indexed
+*        batch with room for another destination rack. stale entries met on the way are dropped, and the entry returned is taken
+*        out, so the caller must index_batch the batch again once the rack is in it
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::find_batch_for(int num_samples) {
+    for (int slack = num_samples; slack <= RACK_CAPACITY; slack++) {
+        vector<int>& bucket = slack_buckets[slack];
+        for (int i = bucket.size() - 1; i >= 0; i--) {
+            int b = bucket[i];
+            bool current = false;
+            int total = 0;
+            if (b < finished_batches.size()) {
+                total = batch_total(finished_batches[b]);
+                int num_sources = finished_batches[b].batch_sources.size();
+                current = min(batch_spots(total) - total, RACK_CAPACITY) == slack && num_sources + destinations_for(total) < BATCH_CAPACITY;
+            }
+            if (!current || fits_batch(finished_batches[b].batch_sources.size() + 1, total + num_samples)) {
+                bucket[i] = bucket.back();
+                bucket.pop_back();
+                if (current) {
+                    return b;
+                }
+            }
+        }
+    }
+
+    while (!roomy_batches.empty()) {
+        int b = roomy_batches.back();
+        roomy_batches.pop_back();
+        if (b >= finished_batches.size()) {
+            continue;
+        }
+        int total = batch_total(finished_batches[b]);
+        int num_sources = finished_batches[b].batch_sources.size();
+        if (num_sources + destinations_for(total) + 2 <= BATCH_CAPACITY) {
+            if (fits_batch(num_sources + 1, total + num_samples)) {
+                return b;
+            }
+            //still roomy, only too full for this rack
+            roomy_batches.push_back(b);
+            break;
+        }
+    }
+    return -1;
+}
+
+/*
+* name: mark_changed
+* purpose: counts a batch as changed by the delta being applied
+* arguments: the index of the batch in finished_batches
+* returns: none
+* notes: a batch is only counted once per delta
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::mark_changed(int batch) {
+    if (batch_delta[batch] != num_deltas) {
+        batch_delta[batch] = num_deltas;
+        num_changed++;
+    }
+}
+
+/*
+* name: begin_trial
+* purpose: starts a trial, after which apply_delta can be called as usual and end_trial takes every change back
+* arguments: none
+* returns: none
+* notes: indexes the plan first if apply_delta would. costs the size of slack_buckets and roomy_batches, about one entry per
+*        batch, instead of a copy of the whole Program with its racks and id index
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::begin_trial() {
+    if (rack_batch.size() != racks.size()) {
+        index_plan();
+    }
+    trial.open = true;
+    trial.saved.assign(finished_batches.size(), false);
+    trial.batches.clear();
+    trial.num_racks = racks.size();
+    trial.num_batches = finished_batches.size();
+    trial.plan_frequencies = plan_frequencies;
+    trial.slack_buckets = slack_buckets;
+    trial.roomy_batches = roomy_batches;
+    trial.lower_bound = batch_lower_bound;
+    trial.num_deltas = num_deltas;
+    trial.num_changed = num_changed;
+    trial.rng = rng;
+}
+
+/*
+* name: end_trial
+* purpose: puts the plan back the way begin_trial found it
+* arguments: none
+* returns: none
+* notes: the racks the trial added are erased from the id index and cut from the Rack_Store, the batches it changed are copied
+*        back (which also brings back any it emptied or renumbered), and the batches it planned are dropped. the id index keeps
+*        any larger size it grew to. does nothing without a trial
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::end_trial() {
+    if (!trial.open) {
+        return;
+    }
+    //newest first, the order that keeps the id index as it was
+    for (int rack = racks.size() - 1; rack >= trial.num_racks; rack--) {
+        rack_by_id.erase(racks, rack);
+    }
+    racks.truncate(trial.num_racks);
+    rack_batch.resize(trial.num_racks);
+
+    //every batch at or past the new end that existed before the trial was saved when it was moved or emptied
+    finished_batches.resize(trial.num_batches);
+    batch_delta.resize(trial.num_batches);
+    for (Saved_Batch& saved : trial.batches) {
+        finished_batches[saved.index] = move(saved.batch);
+        batch_delta[saved.index] = saved.delta;
+        for (int rack : finished_batches[saved.index].batch_sources) {
+            rack_batch[rack] = saved.index;
+        }
+    }
+
+    plan_frequencies = trial.plan_frequencies;
+    slack_buckets = move(trial.slack_buckets);
+    roomy_batches = move(trial.roomy_batches);
+    batch_lower_bound = trial.lower_bound;
+    num_deltas = trial.num_deltas;
+    num_changed = trial.num_changed;
+    rng = trial.rng;
+    trial = Replan_Trial();
+}
+
+/*
+* name: save_for_trial
+* purpose: keeps a batch as it is for end_trial, before a delta applied during a trial first changes it
+* arguments: the index of the batch in finished_batches
+* returns: none
+* notes: does nothing without a trial, for a batch already saved, or for a batch the trial itself planned
+*/
+template <int RACK_CAPACITY, int BATCH_CAPACITY>
+void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::save_for_trial(int batch) {
+    if (!trial.open || batch >= trial.num_batches || trial.saved[batch]) {
+        return;
+    }
+    trial.saved[batch] = true;
+    trial.batches.push_back({ batch, finished_batches[batch], batch_delta[batch] });
+}
+
+#define INSTANTIATE_REPLAN(RACK_CAPACITY, BATCH_CAPACITY) \
+    template bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::read_plan(istream& in, string& error); \
+    template int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::index_plan(); \
+    template bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::apply_delta(istream& in, string& error); \
+    template bool Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::fits_batch(int num_sources, int total); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::index_batch(int batch); \
+    template int Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::find_batch_for(int num_samples); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::mark_changed(int batch); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::compact_racks(); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::begin_trial(); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::end_trial(); \
+    template void Basic_Program<RACK_CAPACITY, BATCH_CAPACITY>::save_for_trial(int batch);
+RACK_FORMATS(INSTANTIATE_REPLAN)